@@ -47,9 +47,7 @@ extern "C" {
 #endif
 
 #if ENABLE_LUA_FLATBUFFERS
-extern "C" {
-  LUALIB_API int luaopen_flatbuffers(lua_State* L);
-}
+#include "lua-flatbuffers.h"
 #endif
 
 /*
@@ -1,57 +1,197 @@
 #include <vector>
+#include <unordered_map>
+#include <string>
 #include <cstring>
+#include <new>
+#include <atomic>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "lua.h"
 #include "lualib.h"
 #include "lauxlib.h"
+#include "lua-flatbuffers.h"
+
+#if ENABLE_LUA_RAPIDJSON
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+// keep the SIMD choice in step with lua-rapidjson, both include the same inline parser
+#if defined(__SSE4_2__)
+#  define RAPIDJSON_SSE42
+#elif defined(__SSE2__)
+#  define RAPIDJSON_SSE2
+#endif
+#include "rapidjson/error/en.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#endif
 
 struct SizedString {
     size_t size;
     const char* string;
 };
 
+enum class BinaryArrayStorage {
+    Owned,      // private copy in BinaryArray::data, the only writable storage
+    Borrowed,   // memory owned by someone else (a Lua string or a C++ host), read-only
+    Mapped,     // read-only mapping of a file, unmapped on destruction
+};
+
 class BinaryArray {
 public:
-    BinaryArray(uint32_t size) { data.resize(size); memset(data.data(), 0, size); }
-    BinaryArray(SizedString str) { data.resize(str.size); memcpy(data.data(), str.string, str.size); }
+    BinaryArray(uint32_t size) { data.resize(size); memset(data.data(), 0, size); Attach(); }
+    BinaryArray(SizedString str) { data.resize(str.size); memcpy(data.data(), str.string, str.size); Attach(); }
+    BinaryArray(SizedString str, BinaryArrayStorage storage) : base((char*)str.string), size((uint32_t)str.size), storage(storage) {}
+
+    ~BinaryArray() {
+        if (storage == BinaryArrayStorage::Mapped) UnmapFile(base, size);
+    }
+
+    // refills a pooled, owned binary array, the buffer keeps its capacity
+    void Reset(uint32_t newSize) {
+        data.assign(newSize, '\0');
+        Attach();
+        verified = false;
+    }
+
+    void Reset(SizedString str) {
+        data.assign(str.string, str.string + str.size);
+        Attach();
+        verified = false;
+    }
 
     SizedString Slice(uint32_t startPos, uint32_t endPos) {
         if (startPos < 0) startPos = 0;
-        if (startPos > data.size()) startPos = (uint32_t)data.size();
+        if (startPos > size) startPos = size;
         if (endPos < startPos) endPos = startPos;
-        if (endPos > data.size()) endPos = (uint32_t)data.size();
-        return SizedString{ endPos - startPos, data.data() + startPos }; 
+        if (endPos > size) endPos = size;
+        return SizedString{ endPos - startPos, base + startPos }; 
     }
 
-    void Grow(uint32_t newSize) {
-        if (newSize < data.size()) return; // invalid args
+    bool Grow(uint32_t newSize) {
+        if (!Writable()) return false;
+        if (newSize < data.size()) return true; // invalid args
         uint32_t oldSize = (uint32_t)data.size();
         uint32_t deltaSize = newSize - oldSize;
         data.resize(newSize);
         memmove(data.data() + deltaSize, data.data(), oldSize);
+        Attach();
+        verified = false;
+        return true;
     }
 
-    void Pad(uint32_t n, uint32_t startPos) {
-        if (startPos < 0 || startPos > data.size()) return; // invalid args
-        if (startPos + n > data.size()) n = (uint32_t)data.size() - startPos;
-        memset(data.data() + startPos, '\0', n);
+    bool Pad(uint32_t n, uint32_t startPos) {
+        if (!Writable()) return false;
+        if (startPos < 0 || startPos > size) return true; // invalid args
+        if (startPos + n > size) n = size - startPos;
+        memset(base + startPos, '\0', n);
+        verified = false;
+        return true;
     }
 
-    void Set(SizedString value, uint32_t position) {
-        if (position < 0 || position > data.size()) return; // invalid args
-        if (position + value.size > data.size()) return; // invalid args
-        memcpy(data.data() + position, value.string, value.size);
+    bool Set(SizedString value, uint32_t position) {
+        if (!Writable()) return false;
+        if (position < 0 || position > size) return true; // invalid args
+        if (position + value.size > size) return true; // invalid args
+        memcpy(base + position, value.string, value.size);
+        verified = false;
+        return true;
+    }
+
+    bool Writable() {
+        return storage == BinaryArrayStorage::Owned;
     }
 
     uint32_t Size() {
-        return (uint32_t)data.size();
+        return size;
+    }
+
+    char* Data(uint32_t position, uint32_t n = 1) {
+        if ((uint64_t)position + n > size) return nullptr; // invalid args
+        return base + position;
     }
 
-    char* Data(uint32_t position) {
-        if (position < 0 || position + 1 > data.size()) return nullptr; // invalid args
-        return data.data() + position;
+    // maps a whole file read-only, returns false and leaves str untouched on failure
+    static bool MapFile(const char* path, SizedString* str) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart >= MAX_MAPPED_SIZE) {
+            CloseHandle(file);
+            return false;
+        }
+        void* ptr = nullptr;
+        if (fileSize.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+        if (fileSize.QuadPart > 0 && ptr == nullptr) return false;
+        str->string = (const char*)ptr;
+        str->size = (size_t)fileSize.QuadPart;
+        return true;
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (uint64_t)st.st_size >= MAX_MAPPED_SIZE) {
+            close(fd);
+            return false;
+        }
+        void* ptr = nullptr;
+        if (st.st_size > 0) {
+            ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) ptr = nullptr;
+        }
+        close(fd);
+        if (st.st_size > 0 && ptr == nullptr) return false;
+        str->string = (const char*)ptr;
+        str->size = (size_t)st.st_size;
+        return true;
+#endif
     }
 
+    static void UnmapFile(char* ptr, uint32_t size) {
+        if (ptr == nullptr) return;
+#ifdef _WIN32
+        UnmapViewOfFile(ptr);
+#else
+        munmap(ptr, size);
+#endif
+    }
+
+    static const uint64_t MAX_MAPPED_SIZE = 0x100000000ull; // offsets are 32 bits
+
+    char* base = nullptr;
+    uint32_t size = 0;
+    BinaryArrayStorage storage = BinaryArrayStorage::Owned;
     std::vector<char> data;
+
+    // Set by flatbuffersnative.verify once the whole buffer checked out against a schema,
+    // cleared again by any write. It only lets to_json skip a second pass with the same schema.
+    // Views don't look at it: the schema may leave fields out, so they range check every read.
+    bool verified = false;
+    uint64_t verifiedSchema = 0; // Schema::id of the schema that set verified
+
+private:
+    void Attach() {
+        base = data.data();
+        size = (uint32_t)data.size();
+    }
 };
 
 class View {
@@ -92,24 +232,466 @@ public:
         v2->binaryArray = binaryArray;
     }
 
+    // reads out of range yield 0 and set outOfRange, the Lua wrappers turn that into an error
     template<typename T>
     T Get(uint32_t offset) {
-        return *((T*)binaryArray->Data(offset));
+        const char* ptr = binaryArray->Data(offset, sizeof(T));
+        if (ptr == nullptr) {
+            outOfRange = true;
+            return 0;
+        }
+        return *((T*)ptr);
     }
 
     uint32_t UnpackUInt32(uint32_t offset) {
-        return *((uint32_t*)binaryArray->Data(offset));
+        return Get<uint32_t>(offset);
     }
 
     BinaryArray* binaryArray;
     uint32_t position;
+    bool outOfRange = false;
 };
 
-class NumType {
+static const uint32_t MAX_BUFFER_SIZE = 0x80000000; // 2 GB
+static const uint32_t VTABLE_METADATA_FIELDS = 2;
+
+// Builds a flatbuffer from the back towards the front, like the Lua builder,
+// but keeps the bytes and the vtable bookkeeping in native memory.
+class Builder {
 public:
-    NumType(const char* name, int bytewidth, const char* packFmt) : name(name), bytewidth(bytewidth), packFmt(packFmt) {}
-    const char* name;
+    Builder(uint32_t initialSize) : head(initialSize) { data.resize(initialSize); }
+
+    // starts over with the buffer it already has, grown to minSize; old bytes stay until overwritten
+    void Reset(uint32_t minSize = 0) {
+        if (data.size() < minSize) data.assign(minSize, '\0');
+        head = (uint32_t)data.size();
+        minalign = 1;
+        nested = false;
+        finished = false;
+        objectEnd = 0;
+        currentVTable.clear();
+        vtables.clear();
+        dedupedVtables = 0;
+        dedupedVtableBytes = 0;
+    }
+
+    uint32_t Offset() {
+        return (uint32_t)data.size() - head;
+    }
+
+    bool Grow(uint32_t desiredSize) {
+        uint32_t oldSize = (uint32_t)data.size();
+        if (oldSize >= MAX_BUFFER_SIZE) return false;
+        uint32_t newSize = oldSize;
+        do {
+            newSize = newSize * 2 > MAX_BUFFER_SIZE ? MAX_BUFFER_SIZE : newSize * 2;
+            if (newSize == 0) newSize = 1;
+        } while (newSize <= desiredSize && newSize < MAX_BUFFER_SIZE);
+
+        // the used bytes live at the back, copy them once into the back of the new buffer
+        std::vector<char> newData(newSize);
+        uint32_t used = oldSize - head;
+        memcpy(newData.data() + newSize - used, data.data() + head, used);
+        data.swap(newData);
+        head += newSize - oldSize;
+        return true;
+    }
+
+    void Pad(uint32_t n) {
+        head -= n;
+        memset(data.data() + head, '\0', n);
+    }
+
+    bool Prep(uint32_t size, uint32_t additionalBytes) {
+        if (size > minalign) minalign = size;
+        uint32_t alignSize = (~(Offset() + additionalBytes) + 1) & (size - 1);
+        uint32_t desiredSize = alignSize + size + additionalBytes;
+        while (head < desiredSize) {
+            if (!Grow(desiredSize)) return false;
+        }
+        Pad(alignSize);
+        return true;
+    }
+
+    template<typename T>
+    void Place(T x) {
+        head -= sizeof(T);
+        memcpy(data.data() + head, &x, sizeof(T));
+    }
+
+    template<typename T>
+    bool Prepend(T x) {
+        if (!Prep(sizeof(T), 0)) return false;
+        Place<T>(x);
+        return true;
+    }
+
+    bool PrependUOffsetRelative(uint32_t off) {
+        if (!Prep(sizeof(uint32_t), 0)) return false;
+        Place<uint32_t>(Offset() - off + sizeof(uint32_t));
+        return true;
+    }
+
+    void StartObject(uint32_t numFields) {
+        currentVTable.assign(numFields, 0);
+        objectEnd = Offset();
+        nested = true;
+    }
+
+    void Slot(uint32_t slotnum) {
+        if (slotnum >= currentVTable.size()) currentVTable.resize(slotnum + 1, 0);
+        currentVTable[slotnum] = Offset();
+    }
+
+    // FNV-1a over the serialized vtable, the full bytes are still compared on a hit
+    static uint64_t HashVtable(const uint16_t* vtable, uint32_t size) {
+        const unsigned char* bytes = (const unsigned char*)vtable;
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint32_t WriteVtable() {
+        Prepend<int32_t>(0);
+        uint32_t objectOffset = Offset();
+
+        // serialize the candidate vtable up front so it can be compared byte by byte
+        vtableScratch.resize(currentVTable.size() + VTABLE_METADATA_FIELDS);
+        vtableScratch[0] = (uint16_t)(vtableScratch.size() * sizeof(uint16_t));
+        vtableScratch[1] = (uint16_t)(objectOffset - objectEnd);
+        for (size_t i = 0; i < currentVTable.size(); ++i) {
+            uint32_t a = currentVTable[i];
+            vtableScratch[i + VTABLE_METADATA_FIELDS] = (uint16_t)(a != 0 ? objectOffset - a : 0);
+        }
+        uint32_t vtableBytes = (uint32_t)(vtableScratch.size() * sizeof(uint16_t));
+
+        uint64_t hash = HashVtable(vtableScratch.data(), vtableBytes);
+        uint32_t existingVTable = 0;
+        auto range = vtables.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            const char* vt2 = data.data() + data.size() - it->second;
+            uint16_t vt2Bytes;
+            memcpy(&vt2Bytes, vt2, sizeof(uint16_t));
+            if (vt2Bytes == vtableBytes && memcmp(vt2, vtableScratch.data(), vtableBytes) == 0) {
+                existingVTable = it->second;
+                break;
+            }
+        }
+
+        if (existingVTable == 0) {
+            for (size_t i = vtableScratch.size(); i > 0; --i) {
+                Prepend<uint16_t>(vtableScratch[i - 1]);
+            }
+            existingVTable = Offset();
+            vtables.emplace(hash, existingVTable);
+        } else {
+            dedupedVtables++;
+            dedupedVtableBytes += vtableBytes;
+        }
+
+        int32_t soffset = (int32_t)(existingVTable - objectOffset);
+        memcpy(data.data() + data.size() - objectOffset, &soffset, sizeof(int32_t));
+
+        currentVTable.clear();
+        return objectOffset;
+    }
+
+    uint32_t EndObject() {
+        nested = false;
+        return WriteVtable();
+    }
+
+    bool StartVector(uint32_t elemSize, uint32_t numElements, uint32_t alignment) {
+        nested = true;
+        return Prep(sizeof(uint32_t), elemSize * numElements) && Prep(alignment, elemSize * numElements);
+    }
+
+    // returns 0 when the buffer cannot grow, callers may have written more elements than they declared
+    uint32_t EndVector(uint32_t vectorNumElements) {
+        nested = false;
+        if (!Prep(sizeof(uint32_t), 0)) return 0;
+        Place<uint32_t>(vectorNumElements);
+        return Offset();
+    }
+
+    bool CreateString(SizedString str, bool nullTerminated) {
+        nested = true;
+        if (!Prep(sizeof(uint32_t), (uint32_t)str.size + (nullTerminated ? 1 : 0))) return false;
+        if (nullTerminated) Place<uint8_t>(0);
+        head -= (uint32_t)str.size;
+        memcpy(data.data() + head, str.string, str.size);
+        return true;
+    }
+
+    // the full output starts with the unused space, zeroed here since Reset leaves the last message in it
+    SizedString Output(bool full) {
+        if (full) {
+            if (head > 0) memset(data.data(), 0, head);
+            return SizedString{ data.size(), data.data() };
+        }
+        return SizedString{ data.size() - head, data.data() + head };
+    }
+
+    // frees a buffer too big to park in the pool, Reset allocates again for the next user
+    void Trim() {
+        if (data.size() > MAX_POOLED_SIZE) std::vector<char>().swap(data);
+    }
+
+    static const uint32_t MAX_POOLED_SIZE = 1 << 16;
+
+    std::vector<char> data;
+    uint32_t head;
+    uint32_t minalign = 1;
+    bool nested = false;
+    bool finished = false;
+    uint32_t objectEnd = 0;
+    std::vector<uint32_t> currentVTable;
+    std::unordered_multimap<uint64_t, uint32_t> vtables; // vtable hash -> vtable offset
+    std::vector<uint16_t> vtableScratch;
+    uint32_t dedupedVtables = 0;
+    uint32_t dedupedVtableBytes = 0;
+};
+
+// Per-thread free lists for BinaryArray and Builder. Collected objects are parked here with their
+// buffers, so a steady stream of messages stops allocating once it is warmed up.
+// A lua_close that runs after the thread's pools are destroyed finds alive cleared and frees directly.
+template<typename T>
+class Pool {
+public:
+    static const size_t MAX_OBJECTS = 16;
+    static const size_t MAX_CAPACITY = 1 << 20; // bigger buffers are freed rather than kept
+
+    Pool() {
+        alive = true;
+    }
+
+    ~Pool() {
+        alive = false;
+        for (T* p : objects) delete p;
+    }
+
+    T* Take() {
+        if (!alive || objects.empty()) return nullptr;
+        T* p = objects.back();
+        objects.pop_back();
+        return p;
+    }
+
+    void Give(T* p, size_t capacity) {
+        if (alive && objects.size() < MAX_OBJECTS && capacity <= MAX_CAPACITY) objects.push_back(p);
+        else delete p;
+    }
+
+private:
+    static thread_local bool alive; // trivially destructible, still readable once the pool is gone
+    std::vector<T*> objects;
+};
+
+template<typename T>
+thread_local bool Pool<T>::alive = false;
+
+static thread_local Pool<BinaryArray> binaryArrayPool;
+static thread_local Pool<Builder> builderPool;
+
+enum class ScalarType : uint8_t {
+    Bool, Uint8, Uint16, Uint32, Uint64, Int8, Int16, Int32, Int64, Count
+};
+
+static const char* SCALAR_TYPE_NAMES[] = { "Bool", "Uint8", "Uint16", "Uint32", "Uint64", "Int8", "Int16", "Int32", "Int64" };
+static const uint32_t SCALAR_TYPE_SIZES[] = { 1, 1, 2, 4, 8, 1, 2, 4, 8 };
+
+enum class FieldType : uint8_t {
+    Deprecated, // slot not described by the schema, skipped
+    Scalar,
+    Struct,
+    String,
+    Table,
+    Vector,
+};
+
+struct SchemaField {
+    std::string name;
+    FieldType type = FieldType::Deprecated;
+    FieldType element = FieldType::Deprecated; // vectors only
+    ScalarType scalar = ScalarType::Uint8; // scalar fields and scalar vectors
+    uint32_t ref = 0; // struct or table index in Schema::objects
+    uint32_t offset = 0; // struct members only
+    bool fixed = false; // raw fixed point value, as written by math.value64
+};
+
+struct SchemaObject {
+    std::string name;
+    bool isStruct = false;
+    uint32_t size = 0; // structs only
+    uint32_t align = 1; // structs only
+    std::vector<SchemaField> fields; // tables index these by slot
+};
+
+// Native form of a schema descriptor, see schema_new for the Lua layout.
+class Schema {
+public:
+    Schema() : id(++lastId) {}
+
+    // bytes the field takes inline, in its table or vector
+    uint32_t InlineSize(FieldType type, const SchemaField& field) {
+        switch (type) {
+        case FieldType::Scalar: return SCALAR_TYPE_SIZES[(int)field.scalar];
+        case FieldType::Struct: return objects[field.ref].size;
+        case FieldType::String:
+        case FieldType::Table:
+        case FieldType::Vector: return sizeof(uint32_t);
+        default: return 0;
+        }
+    }
+
+    std::vector<SchemaObject> objects;
+    uint32_t root = 0;
+    const uint64_t id; // unlike the address, never reused by a later schema
+
+private:
+    static std::atomic<uint64_t> lastId;
+};
+
+std::atomic<uint64_t> Schema::lastId{ 0 };
+
+static const uint32_t DEFAULT_MAX_DEPTH = 64;
+static const uint32_t DEFAULT_MAX_TABLES = 1000000;
+
+// Walks a whole buffer once and checks every offset, vtable, vector and string against a schema,
+// so that a truncated or malicious buffer is rejected before any accessor touches it.
+class Verifier {
+public:
+    Verifier(BinaryArray* binaryArray, Schema* schema, uint32_t maxDepth, uint32_t maxTables)
+        : binaryArray(binaryArray), schema(schema), maxDepth(maxDepth), maxTables(maxTables) {}
+
+    bool VerifyBuffer() {
+        uint32_t root;
+        if (!VerifyOffset(0, &root)) return false;
+        return VerifyTable(root, schema->root);
+    }
+
+    const char* error = nullptr;
+
+private:
+    bool Fail(const char* message) {
+        error = message;
+        return false;
+    }
+
+    bool InRange(uint64_t offset, uint64_t n) {
+        return offset + n <= binaryArray->size;
+    }
+
+    template<typename T>
+    T Read(uint32_t offset) {
+        T ret;
+        memcpy(&ret, binaryArray->base + offset, sizeof(T));
+        return ret;
+    }
+
+    bool VerifyOffset(uint32_t offset, uint32_t* target) {
+        if (!InRange(offset, sizeof(uint32_t))) return Fail("offset out of range");
+        uint32_t off = Read<uint32_t>(offset);
+        if (off == 0 || !InRange((uint64_t)offset + off, sizeof(uint32_t))) return Fail("offset target out of range");
+        *target = offset + off;
+        return true;
+    }
+
+    bool VerifyVector(uint32_t position, uint32_t elemSize, uint32_t* length) {
+        if (!InRange(position, sizeof(uint32_t))) return Fail("vector out of range");
+        *length = Read<uint32_t>(position);
+        if (!InRange((uint64_t)position + sizeof(uint32_t), (uint64_t)*length * elemSize)) return Fail("vector elements out of range");
+        return true;
+    }
+
+    bool VerifyString(uint32_t position) {
+        uint32_t length;
+        if (!VerifyVector(position, 1, &length)) return false;
+        uint64_t end = (uint64_t)position + sizeof(uint32_t) + length;
+        if (!InRange(end, 1) || binaryArray->base[end] != '\0') return Fail("string is not terminated");
+        return true;
+    }
+
+    bool VerifyReference(uint32_t offset, FieldType type, const SchemaField& field) {
+        uint32_t target;
+        if (!VerifyOffset(offset, &target)) return false;
+        switch (type) {
+        case FieldType::String: return VerifyString(target);
+        case FieldType::Table: return VerifyTable(target, field.ref);
+        default: return Fail("unexpected field type");
+        }
+    }
+
+    bool VerifyVectorField(uint32_t offset, const SchemaField& field) {
+        uint32_t position;
+        if (!VerifyOffset(offset, &position)) return false;
+        uint32_t elemSize = schema->InlineSize(field.element, field);
+        uint32_t length;
+        if (!VerifyVector(position, elemSize, &length)) return false;
+        if (field.element == FieldType::String || field.element == FieldType::Table) {
+            uint32_t elem = position + sizeof(uint32_t);
+            for (uint32_t i = 0; i < length; ++i, elem += elemSize) {
+                if (!VerifyReference(elem, field.element, field)) return false;
+            }
+        }
+        return true;
+    }
+
+    bool VerifyTable(uint32_t position, uint32_t ref) {
+        if (++depth > maxDepth) return Fail("nesting too deep");
+        if (++tables > maxTables) return Fail("too many tables");
+
+        if (!InRange(position, sizeof(int32_t))) return Fail("table out of range");
+        int64_t vtable = (int64_t)position - Read<int32_t>(position);
+        if (vtable < 0 || !InRange((uint64_t)vtable, 2 * sizeof(uint16_t))) return Fail("vtable out of range");
+        uint32_t vtableSize = Read<uint16_t>((uint32_t)vtable);
+        if ((vtableSize & 1) != 0 || vtableSize < 2 * sizeof(uint16_t) || !InRange((uint64_t)vtable, vtableSize)) {
+            return Fail("invalid vtable");
+        }
+        uint32_t objectSize = Read<uint16_t>((uint32_t)vtable + sizeof(uint16_t));
+        if (objectSize < sizeof(int32_t) || !InRange(position, objectSize)) return Fail("invalid table size");
+
+        const SchemaObject& object = schema->objects[ref];
+        size_t slots = (vtableSize - 2 * sizeof(uint16_t)) / sizeof(uint16_t);
+        if (slots > object.fields.size()) slots = object.fields.size();
+        for (size_t slot = 0; slot < slots; ++slot) {
+            uint32_t fieldOffset = Read<uint16_t>((uint32_t)vtable + (uint32_t)((slot + 2) * sizeof(uint16_t)));
+            const SchemaField& field = object.fields[slot];
+            if (fieldOffset == 0 || field.type == FieldType::Deprecated) continue;
+            if (fieldOffset + schema->InlineSize(field.type, field) > objectSize) return Fail("field out of table");
+
+            uint32_t offset = position + fieldOffset;
+            bool ok = true;
+            switch (field.type) {
+            case FieldType::String:
+            case FieldType::Table: ok = VerifyReference(offset, field.type, field); break;
+            case FieldType::Vector: ok = VerifyVectorField(offset, field); break;
+            default: break; // scalars and structs are inline, covered by the size check
+            }
+            if (!ok) return false;
+        }
+
+        depth--;
+        return true;
+    }
+
+    BinaryArray* binaryArray;
+    Schema* schema;
+    uint32_t maxDepth;
+    uint32_t maxTables;
+    uint32_t depth = 0;
+    uint32_t tables = 0;
+};
+
+// Every entry of flatbuffersnative.N shares this layout and the "num_type_mt" metatable,
+// the type tag selects the scalar type without any lookup by name.
+struct NumType {
+    ScalarType type;
     int bytewidth;
+    const char* name;
     const char* packFmt;
 };
 
@@ -118,121 +700,178 @@ struct BinaryArrayRef {
     bool is_owner;
 };
 
+// Every native function is registered with the module's metatables as upvalues, so type checks
+// compare metatables directly instead of looking them up in the registry by name.
+enum {
+    UPVALUE_BA_MT = 1,
+    UPVALUE_VIEW_MT,
+    UPVALUE_NUM_TYPE_MT,
+    UPVALUE_BUILDER_MT,
+    UPVALUE_SCHEMA_MT,
+    UPVALUE_COUNT = UPVALUE_SCHEMA_MT
+};
+
+static const char* UPVALUE_METATABLES[] = { "ba_mt", "view_mt", "num_type_mt", "builder_mt", "schema_mt" };
+
+static void* check_udata(lua_State* L, int n, int upvalue) {
+    void* userdata = lua_touserdata(L, n);
+    if (userdata != nullptr && lua_getmetatable(L, n)) {
+        bool same = lua_rawequal(L, -1, lua_upvalueindex(upvalue));
+        lua_pop(L, 1);
+        if (same) return userdata;
+    }
+    return luaL_checkudata(L, n, UPVALUE_METATABLES[upvalue - 1]); // raises the type error
+}
+
+static void push_metatables(lua_State* L) {
+    for (const char* name : UPVALUE_METATABLES) luaL_getmetatable(L, name);
+}
+
+static void set_funcs(lua_State* L, const luaL_Reg* reg) {
+    push_metatables(L);
+    luaL_setfuncs(L, reg, UPVALUE_COUNT);
+}
+
+static void push_function(lua_State* L, lua_CFunction f) {
+    push_metatables(L);
+    lua_pushcclosure(L, f, UPVALUE_COUNT);
+}
+
 BinaryArray* check_binaryarray(lua_State* L, int n) {
-    return ((BinaryArrayRef*)luaL_checkudata(L, n, "ba_mt"))->ptr;
+    return ((BinaryArrayRef*)check_udata(L, n, UPVALUE_BA_MT))->ptr;
 }
 
 View* check_view(lua_State* L, int n) {
-    return *(View**)luaL_checkudata(L, n, "view_mt");
+    return (View*)check_udata(L, n, UPVALUE_VIEW_MT);
 }
 
-NumType* check_num_type(lua_State* L, int n, const char* name) {
-    return *(NumType**)luaL_checkudata(L, n, name);
+NumType* check_num_type(lua_State* L, int n) {
+    return (NumType*)check_udata(L, n, UPVALUE_NUM_TYPE_MT);
 }
 
-NumType* test_num_type(lua_State* L, int n, const char* name) {
-    void* userdata = luaL_testudata(L, n, name);
-    if (userdata != nullptr) return *(NumType**)userdata;
-    return nullptr;
+Builder* check_builder(lua_State* L, int n) {
+    return *(Builder**)check_udata(L, n, UPVALUE_BUILDER_MT);
 }
 
-static int num_type_unpack(lua_State* L) {
-    BinaryArray* ba = check_binaryarray(L, 2);
-    uint32_t offset = (uint32_t)luaL_checkinteger(L, 3);
-    void* ptr = ba->Data(offset);
+Schema* check_schema(lua_State* L, int n) {
+    return *(Schema**)check_udata(L, n, UPVALUE_SCHEMA_MT);
+}
 
-    NumType* num_type = nullptr;
-    if ((num_type = test_num_type(L, 1, "Bool"))) {
-        lua_pushinteger(L, *((uint8_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Uint8"))) {
-        lua_pushinteger(L, *((uint8_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Uint16"))) {
-        lua_pushinteger(L, *((uint16_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Uint32"))) {
-        lua_pushinteger(L, *((uint32_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Uint64"))) {
-        lua_pushinteger(L, *((uint64_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Int8"))) {
-        lua_pushinteger(L, *((int8_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Int16"))) {
-        lua_pushinteger(L, *((int16_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Int32"))) {
-        lua_pushinteger(L, *((int32_t*)ptr));
-        return 1;
-    } else if ((num_type = test_num_type(L, 1, "Int64"))) {
-        lua_pushinteger(L, *((int64_t*)ptr));
-        return 1;
-    }
+template<typename T>
+static lua_Integer read_scalar(const char* ptr) {
+    T ret;
+    memcpy(&ret, ptr, sizeof(T));
+    return (lua_Integer)ret;
+}
 
-    lua_pushliteral(L, "incorrect argument");
-    lua_error(L);
-    return 0;
+static lua_Integer read_scalar(ScalarType type, const char* ptr) {
+    switch (type) {
+    case ScalarType::Bool:
+    case ScalarType::Uint8: return read_scalar<uint8_t>(ptr);
+    case ScalarType::Uint16: return read_scalar<uint16_t>(ptr);
+    case ScalarType::Uint32: return read_scalar<uint32_t>(ptr);
+    case ScalarType::Uint64: return read_scalar<uint64_t>(ptr);
+    case ScalarType::Int8: return read_scalar<int8_t>(ptr);
+    case ScalarType::Int16: return read_scalar<int16_t>(ptr);
+    case ScalarType::Int32: return read_scalar<int32_t>(ptr);
+    case ScalarType::Int64: return read_scalar<int64_t>(ptr);
+    default: return 0;
+    }
 }
 
-static int num_type_gc(lua_State* L) {
-    NumType* num_type = nullptr;
-    if ((num_type = test_num_type(L, 1, "Bool")) ||
-        (num_type = test_num_type(L, 1, "Uint8")) ||
-        (num_type = test_num_type(L, 1, "Uint16")) ||
-        (num_type = test_num_type(L, 1, "Uint32")) ||
-        (num_type = test_num_type(L, 1, "Uint64")) ||
-        (num_type = test_num_type(L, 1, "Int8")) ||
-        (num_type = test_num_type(L, 1, "Int16")) ||
-        (num_type = test_num_type(L, 1, "Int32")) ||
-        (num_type = test_num_type(L, 1, "Int64"))) {
-        delete num_type;
+// stores little endian like Builder::Place, which the rest of the code already assumes of the host
+static void write_scalar(char* ptr, int bytewidth, lua_Integer x) {
+    switch (bytewidth) {
+    case 1: { uint8_t v = (uint8_t)x; memcpy(ptr, &v, sizeof(v)); break; }
+    case 2: { uint16_t v = (uint16_t)x; memcpy(ptr, &v, sizeof(v)); break; }
+    case 4: { uint32_t v = (uint32_t)x; memcpy(ptr, &v, sizeof(v)); break; }
+    case 8: { uint64_t v = (uint64_t)x; memcpy(ptr, &v, sizeof(v)); break; }
+    default: break;
     }
-    return 0;
 }
 
-static void register_num_type(lua_State* L, const char* name, NumType* num_type) {
+// native math.value64 and math.fixed64, fixed point fields are stored as raw 64-bit values
+static lua_Integer to_value64(lua_Number n) {
+#ifdef LUA_FIXED32
+    return (lua_Integer)n << 16L;
+#else
+    return (lua_Integer)n;
+#endif
+}
+
+static lua_Number from_value64(lua_Integer i) {
+#ifdef LUA_FIXED32
+    return (lua_Number)i >> 16L;
+#else
+    return (lua_Number)i;
+#endif
+}
+
+static int num_type_unpack(lua_State* L) {
+    NumType* num_type = check_num_type(L, 1);
+    BinaryArray* ba = check_binaryarray(L, 2);
+    uint32_t offset = (uint32_t)luaL_checkinteger(L, 3);
+    const char* ptr = ba->Data(offset, num_type->bytewidth);
+    if (ptr == nullptr) return luaL_error(L, "offset out of range");
+    lua_pushinteger(L, read_scalar(num_type->type, ptr));
+    return 1;
+}
+
+// bytewidth, packFmt and name live in a per-type table kept as the userdata's uservalue
+static int num_type_index(lua_State* L) {
+    check_num_type(L, 1);
+    lua_getuservalue(L, 1);
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, -2) != LUA_TNIL) return 1;
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(UPVALUE_NUM_TYPE_MT));
+    return 1;
+}
+
+static void register_num_type(lua_State* L) {
     luaL_Reg num_type_reg[] = {
         { "Unpack", num_type_unpack },
-        { "__gc", num_type_gc },
+        { "__index", num_type_index },
         { nullptr, nullptr }
     };
 
-    luaL_newmetatable(L, name); // [mt]
-    luaL_setfuncs(L, num_type_reg, 0); // [mt]
-
-    lua_pushinteger(L, num_type->bytewidth); // [mt, bytewidth]
-    lua_setfield(L, -2, "bytewidth"); // [mt]
-
-    lua_pushstring(L, num_type->packFmt); // [mt, packFmt]
-    lua_setfield(L, -2, "packFmt"); // [mt]
-
-    lua_setfield(L, -1, "__index"); // []
+    luaL_newmetatable(L, "num_type_mt"); // [mt]
+    set_funcs(L, num_type_reg); // [mt]
+    lua_pop(L, 1); // []
 }
 
-static void num_type_new(lua_State* L, const char* name, int bytewidth, const char* packFmt) {
+static void num_type_new(lua_State* L, ScalarType type, const char* packFmt) {
     // assume stack top is a table of num_type [num_type_table]
-    NumType** udata = (NumType**)lua_newuserdata(L, sizeof(NumType*));
-    *udata = new NumType(name, bytewidth, packFmt);
-    register_num_type(L, name, *udata);
-    luaL_getmetatable(L, name);
+    NumType* udata = (NumType*)lua_newuserdata(L, sizeof(NumType));
+    udata->type = type;
+    udata->bytewidth = (int)SCALAR_TYPE_SIZES[(int)type];
+    udata->name = SCALAR_TYPE_NAMES[(int)type];
+    udata->packFmt = packFmt;
+    luaL_getmetatable(L, "num_type_mt");
     lua_setmetatable(L, -2);
-    lua_setfield(L, -2, name); // [num_type_table]
+    lua_createtable(L, 0, 3); // [num_type_table, num_type, fields]
+    lua_pushinteger(L, udata->bytewidth);
+    lua_setfield(L, -2, "bytewidth");
+    lua_pushstring(L, udata->packFmt);
+    lua_setfield(L, -2, "packFmt");
+    lua_pushstring(L, udata->name);
+    lua_setfield(L, -2, "name");
+    lua_setuservalue(L, -2); // [num_type_table, num_type]
+    lua_setfield(L, -2, udata->name); // [num_type_table]
 }
 
 static void new_num_types_table(lua_State* L) {
     lua_newtable(L);
 
-    num_type_new(L, "Bool", 1, "<b");
-    num_type_new(L, "Uint8", 1, "<I1");
-    num_type_new(L, "Uint16", 2, "<I2");
-    num_type_new(L, "Uint32", 4, "<I4");
-    num_type_new(L, "Uint64", 8, "<I8");
-    num_type_new(L, "Int8", 1, "<i1");
-    num_type_new(L, "Int16", 2, "<i2");
-    num_type_new(L, "Int32", 4, "<i4");
-    num_type_new(L, "Int64", 8, "<i8");
+    num_type_new(L, ScalarType::Bool, "<b");
+    num_type_new(L, ScalarType::Uint8, "<I1");
+    num_type_new(L, ScalarType::Uint16, "<I2");
+    num_type_new(L, ScalarType::Uint32, "<I4");
+    num_type_new(L, ScalarType::Uint64, "<I8");
+    num_type_new(L, ScalarType::Int8, "<i1");
+    num_type_new(L, ScalarType::Int16, "<i2");
+    num_type_new(L, ScalarType::Int32, "<i4");
+    num_type_new(L, ScalarType::Int64, "<i8");
 
     lua_pushliteral(L, "Uint32");
     lua_gettable(L, -2);
@@ -247,23 +886,30 @@ static void new_num_types_table(lua_State* L) {
     lua_setfield(L, -2, "SOffsetT");
 }
 
+static BinaryArray* push_binaryarray(lua_State* L, BinaryArray* ba) {
+    BinaryArrayRef* ba_ref = (BinaryArrayRef*)lua_newuserdata(L, sizeof(BinaryArrayRef));
+    ba_ref->ptr = ba;
+    ba_ref->is_owner = true;
+    luaL_getmetatable(L, "ba_mt");
+    lua_setmetatable(L, -2);
+    return ba;
+}
+
 static int ba_new(lua_State* L) {
     if (lua_isnumber(L, 1)) {
         uint32_t size = (uint32_t)lua_tointeger(L, 1);
-        BinaryArrayRef* ba_ref = (BinaryArrayRef*)lua_newuserdata(L, sizeof(BinaryArrayRef));
-        ba_ref->ptr = new BinaryArray(size);
-        ba_ref->is_owner = true;
-        luaL_getmetatable(L, "ba_mt");
-        lua_setmetatable(L, -2);
+        BinaryArray* ba = binaryArrayPool.Take();
+        if (ba != nullptr) ba->Reset(size);
+        else ba = new BinaryArray(size);
+        push_binaryarray(L, ba);
         return 1;
     } else if (lua_isstring(L, 1)) {
         SizedString str;
         str.string = lua_tolstring(L, 1, &str.size);
-        BinaryArrayRef* ba_ref = (BinaryArrayRef*)lua_newuserdata(L, sizeof(BinaryArrayRef));
-        ba_ref->ptr = new BinaryArray(str);
-        ba_ref->is_owner = true;
-        luaL_getmetatable(L, "ba_mt");
-        lua_setmetatable(L, -2);
+        BinaryArray* ba = binaryArrayPool.Take();
+        if (ba != nullptr) ba->Reset(str);
+        else ba = new BinaryArray(str);
+        push_binaryarray(L, ba);
         return 1;
     }
     lua_pushliteral(L, "incorrect argument");
@@ -271,6 +917,45 @@ static int ba_new(lua_State* L) {
     return 0;
 }
 
+// borrow_binaryarray(str), wraps the string without copying it and keeps it alive through the uservalue.
+// Native hosts hand out their own memory with flatbuffers_push_binaryarray.
+static int ba_borrow(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TSTRING);
+    SizedString str;
+    str.string = lua_tolstring(L, 1, &str.size);
+    luaL_argcheck(L, str.size < BinaryArray::MAX_MAPPED_SIZE, 1, "buffer too large");
+    push_binaryarray(L, new BinaryArray(str, BinaryArrayStorage::Borrowed));
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+    return 1;
+}
+
+// map_binaryarray(path), returns nil and a message when the file can't be mapped
+static int ba_map(lua_State* L) {
+    const char* path = luaL_checkstring(L, 1);
+    SizedString str;
+    if (!BinaryArray::MapFile(path, &str)) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "cannot map file '%s'", path);
+        return 2;
+    }
+    push_binaryarray(L, new BinaryArray(str, BinaryArrayStorage::Mapped));
+    return 1;
+}
+
+// ba:IsVerified([schema]), whether verify passed since the last write, against schema when one is given
+static int ba_is_verified(lua_State* L) {
+    BinaryArray* ba = check_binaryarray(L, 1);
+    bool verified = ba->verified;
+    if (!lua_isnoneornil(L, 2)) verified = verified && ba->verifiedSchema == check_schema(L, 2)->id;
+    lua_pushboolean(L, verified);
+    return 1;
+}
+
+static void ba_check_writable(lua_State* L, bool ok) {
+    if (!ok) luaL_error(L, "binary array is read-only");
+}
+
 static int ba_slice(lua_State* L) {
     BinaryArray* ba = check_binaryarray(L, 1);
     uint32_t startPos = (uint32_t)luaL_checkinteger(L, 2);
@@ -283,7 +968,7 @@ static int ba_slice(lua_State* L) {
 static int ba_grow(lua_State* L) {
     BinaryArray* ba = check_binaryarray(L, 1);
     uint32_t newSize = (uint32_t)luaL_checkinteger(L, 2);
-    ba->Grow(newSize);
+    ba_check_writable(L, ba->Grow(newSize));
     return 0;
 }
 
@@ -291,7 +976,7 @@ static int ba_pad(lua_State* L) {
     BinaryArray* ba = check_binaryarray(L, 1);
     uint32_t n = (uint32_t)luaL_checkinteger(L, 2);
     uint32_t startPos = (uint32_t)luaL_checkinteger(L, 3);
-    ba->Pad(n, startPos);
+    ba_check_writable(L, ba->Pad(n, startPos));
     return 0;
 }
 
@@ -300,7 +985,7 @@ static int ba_set(lua_State* L) {
     SizedString value;
     value.string = luaL_checklstring(L, 2, &value.size);
     uint32_t position = (uint32_t)luaL_checkinteger(L, 3);
-    ba->Set(value, position);
+    ba_check_writable(L, ba->Set(value, position));
     return 0;
 }
 
@@ -313,7 +998,10 @@ static int ba_size(lua_State* L) {
 
 static int ba_gc(lua_State* L) {
     BinaryArrayRef* ba_ref = ((BinaryArrayRef*)luaL_checkudata(L, 1, "ba_mt"));
-    if (ba_ref->is_owner) delete ba_ref->ptr;
+    if (!ba_ref->is_owner) return 0;
+    BinaryArray* ba = ba_ref->ptr;
+    if (ba->Writable()) binaryArrayPool.Give(ba, ba->data.capacity());
+    else delete ba;
     return 0;
 }
 
@@ -323,30 +1011,40 @@ static void register_binaryarray(lua_State* L) {
         { "Grow", ba_grow },
         { "Pad", ba_pad },
         { "Set", ba_set },
+        { "IsVerified", ba_is_verified },
         { "__len", ba_size },
         { "__gc", ba_gc },
         { nullptr, nullptr }
     };
 
     luaL_newmetatable(L, "ba_mt");
-    luaL_setfuncs(L, binaryarray_reg, 0);
+    set_funcs(L, binaryarray_reg);
     lua_setfield(L, -1, "__index");
 }
 
 static int view_new(lua_State* L) {
     BinaryArray* ba = check_binaryarray(L, 1);
     uint32_t position = (uint32_t)luaL_checkinteger(L, 2);
-    View** udata = (View**)lua_newuserdata(L, sizeof(View*));
-    *udata = new View(ba, position);
-    luaL_getmetatable(L, "view_mt");
+    new (lua_newuserdata(L, sizeof(View))) View(ba, position); // inline, nothing to free
+    lua_pushvalue(L, lua_upvalueindex(UPVALUE_VIEW_MT));
     lua_setmetatable(L, -2);
+    lua_pushvalue(L, 1); // the view keeps its binary array, and whatever that borrows from, alive
+    lua_setuservalue(L, -2);
     return 1;
 }
 
+static void check_view_range(lua_State* L, View* view) {
+    if (view->outOfRange) {
+        view->outOfRange = false;
+        luaL_error(L, "offset out of range");
+    }
+}
+
 static int view_offset(lua_State* L) {
     View* view = check_view(L, 1);
     uint32_t vtableOffset = (uint32_t)luaL_checkinteger(L, 2);
     uint32_t ret = view->Offset(vtableOffset);
+    check_view_range(L, view);
     lua_pushinteger(L, ret);
     return 1;
 }
@@ -355,6 +1053,7 @@ static int view_indirect(lua_State* L) {
     View* view = check_view(L, 1);
     uint32_t offset = (uint32_t)luaL_checkinteger(L, 2);
     uint32_t ret = view->Indirect(offset);
+    check_view_range(L, view);
     lua_pushinteger(L, ret);
     return 1;
 }
@@ -363,6 +1062,7 @@ static int view_string(lua_State* L) {
     View* view = check_view(L, 1);
     uint32_t offset = (uint32_t)luaL_checkinteger(L, 2);
     SizedString ret = view->String(offset);
+    check_view_range(L, view);
     lua_pushlstring(L, ret.string, ret.size);
     return 1;
 }
@@ -371,6 +1071,7 @@ static int view_vector_len(lua_State* L) {
     View* view = check_view(L, 1);
     uint32_t offset = (uint32_t)luaL_checkinteger(L, 2);
     uint32_t ret = view->VectorLen(offset);
+    check_view_range(L, view);
     lua_pushinteger(L, ret);
     return 1;
 }
@@ -379,6 +1080,7 @@ static int view_vector(lua_State* L) {
     View* view = check_view(L, 1);
     uint32_t offset = (uint32_t)luaL_checkinteger(L, 2);
     uint32_t ret = view->Vector(offset);
+    check_view_range(L, view);
     lua_pushinteger(L, ret);
     return 1;
 }
@@ -388,41 +1090,40 @@ static int view_union(lua_State* L) {
     View* view2 = check_view(L, 2);
     uint32_t offset = (uint32_t)luaL_checkinteger(L, 3);
     view->Union(view2, offset);
+    check_view_range(L, view);
+    lua_getuservalue(L, 1);
+    lua_setuservalue(L, 2);
     return 0;
 }
 
-static int view_get(lua_State* L) {
-    View* view = check_view(L, 1);
-    uint32_t offset = (uint32_t)luaL_checkinteger(L, 3);
+template<typename T>
+static int view_push_get(lua_State* L, View* view, uint32_t offset) {
+    T ret = view->Get<T>(offset);
+    check_view_range(L, view);
+    lua_pushinteger(L, ret);
+    return 1;
+}
 
-    NumType* num_type = nullptr;
-    if ((num_type = test_num_type(L, 2, "Bool"))) {
-        lua_pushinteger(L, view->Get<uint8_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Uint8"))) {
-        lua_pushinteger(L, view->Get<uint8_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Uint16"))) {
-        lua_pushinteger(L, view->Get<uint16_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Uint32"))) {
-        lua_pushinteger(L, view->Get<uint32_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Uint64"))) {
-        lua_pushinteger(L, view->Get<uint64_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Int8"))) {
-        lua_pushinteger(L, view->Get<int8_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Int16"))) {
-        lua_pushinteger(L, view->Get<int16_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Int32"))) {
-        lua_pushinteger(L, view->Get<int32_t>(offset));
-        return 1;
-    } else if ((num_type = test_num_type(L, 2, "Int64"))) {
-        lua_pushinteger(L, view->Get<int64_t>(offset));
-        return 1;
+// Bool is pushed as a boolean when boolean is set, the way the generated accessors return it
+static int view_push_scalar(lua_State* L, View* view, ScalarType type, uint32_t offset, bool boolean) {
+    switch (type) {
+    case ScalarType::Bool:
+        if (boolean) {
+            uint8_t ret = view->Get<uint8_t>(offset);
+            check_view_range(L, view);
+            lua_pushboolean(L, ret != 0);
+            return 1;
+        }
+        return view_push_get<uint8_t>(L, view, offset);
+    case ScalarType::Uint8: return view_push_get<uint8_t>(L, view, offset);
+    case ScalarType::Uint16: return view_push_get<uint16_t>(L, view, offset);
+    case ScalarType::Uint32: return view_push_get<uint32_t>(L, view, offset);
+    case ScalarType::Uint64: return view_push_get<uint64_t>(L, view, offset);
+    case ScalarType::Int8: return view_push_get<int8_t>(L, view, offset);
+    case ScalarType::Int16: return view_push_get<int16_t>(L, view, offset);
+    case ScalarType::Int32: return view_push_get<int32_t>(L, view, offset);
+    case ScalarType::Int64: return view_push_get<int64_t>(L, view, offset);
+    default: break;
     }
 
     lua_pushliteral(L, "incorrect argument");
@@ -430,73 +1131,1548 @@ static int view_get(lua_State* L) {
     return 0;
 }
 
-static int view_index(lua_State* L) {
+static int view_get(lua_State* L) {
     View* view = check_view(L, 1);
-    const char* key = luaL_checkstring(L, 2);
-    if (strcmp(key, "pos") == 0) {
-        lua_pushinteger(L, view->position);
-        return 1;
-    } else if (strcmp(key, "bytes") == 0) {
-        BinaryArrayRef* ba = (BinaryArrayRef*)lua_newuserdata(L, sizeof(BinaryArrayRef));
-        ba->ptr = view->binaryArray;
-        ba->is_owner = false;
-        luaL_getmetatable(L, "ba_mt");
-        lua_setmetatable(L, -2);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t offset = (uint32_t)luaL_checkinteger(L, 3);
+    return view_push_scalar(L, view, num_type->type, offset, false);
+}
+
+// Fused accessors: each resolves the vtable slot and reads the field in a single call,
+// replacing the Offset + Get (or Indirect, String, Vector) pairs of the generated code.
+
+// returns the absolute position of the field, or 0 when it is absent
+static uint32_t view_field_position(lua_State* L, View* view, int n) {
+    uint32_t vtableOffset = (uint32_t)luaL_checkinteger(L, n);
+    uint32_t o = view->Offset(vtableOffset);
+    check_view_range(L, view);
+    return o != 0 ? o + view->position : 0;
+}
+
+// view:Field(N.X, vtoffset, default [, fixed]), Bool fields yield booleans and fixed converts
+// through math.fixed64; default is returned as given when the field is absent
+static int view_field(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t position = view_field_position(L, view, 3);
+    if (position == 0) {
+        lua_settop(L, 4);
         return 1;
-    } else {
-        luaL_getmetatable(L, "view_mt_mt");
-        lua_getfield(L, -1, key);
-        lua_replace(L, -2);
+    }
+    if (lua_toboolean(L, 5)) {
+        view_push_scalar(L, view, num_type->type, position, false);
+        lua_pushnumber(L, from_value64(lua_tointeger(L, -1)));
         return 1;
     }
+    return view_push_scalar(L, view, num_type->type, position, true);
 }
 
-static int view_gc(lua_State* L) {
+// view:FieldString(vtoffset), nil when absent
+static int view_field_string(lua_State* L) {
     View* view = check_view(L, 1);
-    delete view;
-    return 0;
+    uint32_t position = view_field_position(L, view, 2);
+    if (position == 0) return 0;
+    SizedString ret = view->String(position);
+    check_view_range(L, view);
+    lua_pushlstring(L, ret.string, ret.size);
+    return 1;
 }
 
-static void register_view(lua_State* L) {
-    luaL_Reg view_mt_mt_reg[] = {
-        { "Offset", view_offset },
-        { "Indirect", view_indirect },
-        { "String", view_string },
-        { "VectorLen", view_vector_len },
-        { "Vector", view_vector },
-        { "Union", view_union },
-        { "Get", view_get },
-        { nullptr, nullptr }
-    };
-
-    luaL_Reg view_mt_reg[] = {
-        { "Offset", view_offset },
-        { "Indirect", view_indirect },
-        { "String", view_string },
-        { "VectorLen", view_vector_len },
-        { "Vector", view_vector },
-        { "Union", view_union },
-        { "Get", view_get },
-        { "__index", view_index },
-        { "__gc", view_gc },
-        { nullptr, nullptr }
-    };
-
-    luaL_newmetatable(L, "view_mt_mt");
-    luaL_setfuncs(L, view_mt_mt_reg, 0);
-    lua_pop(L, 1);
-
-    luaL_newmetatable(L, "view_mt");
-    luaL_setfuncs(L, view_mt_reg, 0);
-    lua_pop(L, 1);
+// view:FieldStruct(vtoffset), the position of an inline struct or nil when absent
+static int view_field_struct(lua_State* L) {
+    View* view = check_view(L, 1);
+    uint32_t position = view_field_position(L, view, 2);
+    if (position == 0) return 0;
+    lua_pushinteger(L, position);
+    return 1;
 }
 
-extern "C" {
+// view:FieldTable(vtoffset), the position of a referenced table or nil when absent
+static int view_field_table(lua_State* L) {
+    View* view = check_view(L, 1);
+    uint32_t position = view_field_position(L, view, 2);
+    if (position == 0) return 0;
+    uint32_t ret = view->Indirect(position);
+    check_view_range(L, view);
+    lua_pushinteger(L, ret);
+    return 1;
+}
+
+// view:FieldVector(vtoffset), the position of the first element and the length, or nil when absent
+static int view_field_vector(lua_State* L) {
+    View* view = check_view(L, 1);
+    uint32_t position = view_field_position(L, view, 2);
+    if (position == 0) return 0;
+    uint32_t start = view->Indirect(position);
+    uint32_t length = view->UnpackUInt32(start);
+    check_view_range(L, view);
+    lua_pushinteger(L, start + sizeof(uint32_t));
+    lua_pushinteger(L, length);
+    return 2;
+}
+
+// view:FieldVectorLen(vtoffset), 0 when absent
+static int view_field_vector_len(lua_State* L) {
+    View* view = check_view(L, 1);
+    uint32_t position = view_field_position(L, view, 2);
+    uint32_t length = position != 0 ? view->UnpackUInt32(view->Indirect(position)) : 0;
+    check_view_range(L, view);
+    lua_pushinteger(L, length);
+    return 1;
+}
+
+// view:VectorElem(N.X, vtoffset, j), element j (1-based) of a scalar vector, 0 (or false) when the vector is absent
+static int view_vector_elem(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t position = view_field_position(L, view, 3);
+    lua_Integer j = luaL_checkinteger(L, 4);
+    if (position == 0) {
+        if (num_type->type == ScalarType::Bool) lua_pushboolean(L, 0);
+        else lua_pushinteger(L, 0);
+        return 1;
+    }
+    uint32_t start = view->Indirect(position);
+    uint32_t length = view->UnpackUInt32(start);
+    check_view_range(L, view);
+    luaL_argcheck(L, 1 <= j && j <= length, 4, "vector index out of range");
+    uint32_t offset = start + sizeof(uint32_t) + (uint32_t)(j - 1) * num_type->bytewidth;
+    return view_push_scalar(L, view, num_type->type, offset, true);
+}
+
+template<typename T>
+static void view_read_vector(lua_State* L, const char* p, uint32_t length, int t, bool fixed) {
+    for (uint32_t i = 0; i < length; ++i) {
+        T x;
+        memcpy(&x, p + i * sizeof(T), sizeof(T));
+        if (fixed) lua_pushnumber(L, from_value64((lua_Integer)x));
+        else lua_pushinteger(L, (lua_Integer)x);
+        lua_rawseti(L, t, (lua_Integer)i + 1);
+    }
+}
+
+// view:ReadVector(N.X, vtoffset [, fixed]), the whole scalar vector as a new array,
+// empty when absent; Bool vectors yield booleans and fixed converts through math.fixed64
+static int view_read_vector_table(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t position = view_field_position(L, view, 3);
+    bool fixed = lua_toboolean(L, 4) != 0;
+    uint32_t start = 0;
+    uint32_t length = 0;
+    if (position != 0) {
+        start = view->Indirect(position) + sizeof(uint32_t);
+        length = view->UnpackUInt32(start - sizeof(uint32_t));
+        check_view_range(L, view);
+    }
+    uint64_t bytes = (uint64_t)length * num_type->bytewidth;
+    if (length > 0 && (bytes > view->binaryArray->Size() || view->binaryArray->Data(start, (uint32_t)bytes) == nullptr)) {
+        luaL_error(L, "offset out of range");
+    }
+    const char* p = view->binaryArray->base + start;
+
+    lua_createtable(L, (int)length, 0);
+    int t = lua_gettop(L);
+    switch (num_type->type) {
+    case ScalarType::Bool:
+        for (uint32_t i = 0; i < length; ++i) {
+            lua_pushboolean(L, p[i] != 0);
+            lua_rawseti(L, t, (lua_Integer)i + 1);
+        }
+        break;
+    case ScalarType::Uint8: view_read_vector<uint8_t>(L, p, length, t, fixed); break;
+    case ScalarType::Uint16: view_read_vector<uint16_t>(L, p, length, t, fixed); break;
+    case ScalarType::Uint32: view_read_vector<uint32_t>(L, p, length, t, fixed); break;
+    case ScalarType::Uint64: view_read_vector<uint64_t>(L, p, length, t, fixed); break;
+    case ScalarType::Int8: view_read_vector<int8_t>(L, p, length, t, fixed); break;
+    case ScalarType::Int16: view_read_vector<int16_t>(L, p, length, t, fixed); break;
+    case ScalarType::Int32: view_read_vector<int32_t>(L, p, length, t, fixed); break;
+    case ScalarType::Int64: view_read_vector<int64_t>(L, p, length, t, fixed); break;
+    default: break;
+    }
+    return 1;
+}
+
+// In-place mutators: each writes one scalar straight into the binary array, which must be owned.
+// Nothing stops the offset or the type width from covering an offset or a vtable, so like any
+// other write they clear the verified flag.
+// They return false when the field is absent and there is nothing to overwrite.
+
+// value is taken like the Prepend functions take it, or through math.value64 when fixed is set
+static int view_mutate_at(lua_State* L, View* view, NumType* num_type, uint32_t position, int value) {
+    BinaryArray* ba = view->binaryArray;
+    ba_check_writable(L, ba->Writable());
+    lua_Integer x;
+    if (lua_toboolean(L, value + 1)) x = to_value64(luaL_checknumber(L, value));
+    else if (lua_isboolean(L, value)) x = lua_toboolean(L, value);
+    else x = luaL_checkinteger(L, value);
+    char* ptr = ba->Data(position, num_type->bytewidth);
+    if (ptr == nullptr) return luaL_error(L, "offset out of range");
+    write_scalar(ptr, num_type->bytewidth, x);
+    ba->verified = false;
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// view:Mutate(N.X, vtoffset, value [, fixed]), a scalar field of this table
+static int view_mutate(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t position = view_field_position(L, view, 3);
+    if (position == 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    return view_mutate_at(L, view, num_type, position, 4);
+}
+
+// view:MutateStruct(N.X, vtoffset, memberOffset, value [, fixed]), a member of an inline struct field of this table
+static int view_mutate_struct(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t position = view_field_position(L, view, 3);
+    uint32_t memberOffset = (uint32_t)luaL_checkinteger(L, 4);
+    if (position == 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    return view_mutate_at(L, view, num_type, position + memberOffset, 5);
+}
+
+// view:MutateMember(N.X, memberOffset, value [, fixed]), a member of the struct this view points at
+static int view_mutate_member(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t memberOffset = (uint32_t)luaL_checkinteger(L, 3);
+    return view_mutate_at(L, view, num_type, view->position + memberOffset, 4);
+}
+
+// view:MutateElem(N.X, vtoffset, j, value [, fixed]), element j (1-based) of a scalar vector of this table
+static int view_mutate_elem(lua_State* L) {
+    View* view = check_view(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t position = view_field_position(L, view, 3);
+    lua_Integer j = luaL_checkinteger(L, 4);
+    if (position == 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+    uint32_t start = view->Indirect(position);
+    uint32_t length = view->UnpackUInt32(start);
+    check_view_range(L, view);
+    luaL_argcheck(L, 1 <= j && j <= length, 4, "vector index out of range");
+    uint32_t offset = start + sizeof(uint32_t) + (uint32_t)(j - 1) * num_type->bytewidth;
+    return view_mutate_at(L, view, num_type, offset, 5);
+}
+
+// view:GetInt32(offset) and friends, the scalar type is fixed at compile time
+template<typename T>
+static int view_get_t(lua_State* L) {
+    View* view = check_view(L, 1);
+    uint32_t offset = (uint32_t)luaL_checkinteger(L, 2);
+    return view_push_get<T>(L, view, offset);
+}
+
+// The computed properties sit in the metatable as lightuserdata tags, so every key,
+// method or property, takes a single rawget.
+static char VIEW_POS;
+static char VIEW_BYTES;
+
+static int view_index(lua_State* L) {
+    View* view = check_view(L, 1);
+    lua_pushvalue(L, 2);
+    if (lua_rawget(L, lua_upvalueindex(UPVALUE_VIEW_MT)) != LUA_TLIGHTUSERDATA) return 1;
+    void* property = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    if (property == &VIEW_POS) {
+        lua_pushinteger(L, view->position);
+        return 1;
+    }
+    if (property == &VIEW_BYTES) {
+        if (lua_getuservalue(L, 1) == LUA_TUSERDATA) return 1;
+        lua_pop(L, 1);
+        BinaryArrayRef* ba = (BinaryArrayRef*)lua_newuserdata(L, sizeof(BinaryArrayRef));
+        ba->ptr = view->binaryArray;
+        ba->is_owner = false;
+        lua_pushvalue(L, lua_upvalueindex(UPVALUE_BA_MT));
+        lua_setmetatable(L, -2);
+        return 1;
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+static void register_view(lua_State* L) {
+    luaL_Reg view_mt_reg[] = {
+        { "Offset", view_offset },
+        { "Indirect", view_indirect },
+        { "String", view_string },
+        { "VectorLen", view_vector_len },
+        { "Vector", view_vector },
+        { "Union", view_union },
+        { "Get", view_get },
+        { "GetBool", view_get_t<uint8_t> },
+        { "GetUint8", view_get_t<uint8_t> },
+        { "GetUint16", view_get_t<uint16_t> },
+        { "GetUint32", view_get_t<uint32_t> },
+        { "GetUint64", view_get_t<uint64_t> },
+        { "GetInt8", view_get_t<int8_t> },
+        { "GetInt16", view_get_t<int16_t> },
+        { "GetInt32", view_get_t<int32_t> },
+        { "GetInt64", view_get_t<int64_t> },
+        { "Field", view_field },
+        { "FieldString", view_field_string },
+        { "FieldStruct", view_field_struct },
+        { "FieldTable", view_field_table },
+        { "FieldVector", view_field_vector },
+        { "FieldVectorLen", view_field_vector_len },
+        { "VectorElem", view_vector_elem },
+        { "ReadVector", view_read_vector_table },
+        { "Mutate", view_mutate },
+        { "MutateStruct", view_mutate_struct },
+        { "MutateMember", view_mutate_member },
+        { "MutateElem", view_mutate_elem },
+        { "__index", view_index },
+        { nullptr, nullptr }
+    };
+
+    luaL_newmetatable(L, "view_mt");
+    set_funcs(L, view_mt_reg);
+    lua_pushlightuserdata(L, &VIEW_POS);
+    lua_setfield(L, -2, "pos");
+    lua_pushlightuserdata(L, &VIEW_BYTES);
+    lua_setfield(L, -2, "bytes");
+    lua_pop(L, 1);
+}
+
+static int builder_new(lua_State* L) {
+    lua_Integer initialSize = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, 0 <= initialSize && initialSize < MAX_BUFFER_SIZE, 1, "invalid initial size");
+    Builder** udata = (Builder**)lua_newuserdata(L, sizeof(Builder*));
+    *udata = builderPool.Take();
+    if (*udata != nullptr) (*udata)->Reset((uint32_t)initialSize);
+    else *udata = new Builder((uint32_t)initialSize);
+    lua_pushvalue(L, lua_upvalueindex(UPVALUE_BUILDER_MT));
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static void builder_check_not_nested(lua_State* L, Builder* builder) {
+    if (builder->nested) luaL_error(L, "builder is nested");
+}
+
+static void builder_check_nested(lua_State* L, Builder* builder) {
+    if (!builder->nested) luaL_error(L, "builder is not nested");
+}
+
+static void builder_check_grow(lua_State* L, bool ok) {
+    if (!ok) luaL_error(L, "Flat Buffers cannot grow buffer beyond 2 gigabytes");
+}
+
+static lua_Integer builder_check_value(lua_State* L, int n) {
+    if (lua_isboolean(L, n)) return lua_toboolean(L, n);
+    return luaL_checkinteger(L, n);
+}
+
+static void builder_place_num(lua_State* L, Builder* builder, NumType* num_type, lua_Integer x) {
+    switch (num_type->bytewidth) {
+    case 1: builder->Place<uint8_t>((uint8_t)x); break;
+    case 2: builder->Place<uint16_t>((uint16_t)x); break;
+    case 4: builder->Place<uint32_t>((uint32_t)x); break;
+    case 8: builder->Place<uint64_t>((uint64_t)x); break;
+    default: luaL_error(L, "incorrect argument"); break;
+    }
+}
+
+static void builder_prepend_num(lua_State* L, Builder* builder, NumType* num_type, lua_Integer x) {
+    builder_check_grow(L, builder->Prep(num_type->bytewidth, 0));
+    builder_place_num(L, builder, num_type, x);
+}
+
+static int builder_output(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    if (!builder->finished) return luaL_error(L, "Builder Not Finished");
+    SizedString ret = builder->Output(lua_toboolean(L, 2));
+    lua_pushlstring(L, ret.string, ret.size);
+    return 1;
+}
+
+// builder:OutputTo(ba [, full]) copies the finished bytes into a reusable binary array and returns it,
+// no Lua string is created and the binary array keeps its capacity from one message to the next
+static int builder_output_to(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    BinaryArray* ba = check_binaryarray(L, 2);
+    if (!builder->finished) return luaL_error(L, "Builder Not Finished");
+    ba_check_writable(L, ba->Writable());
+    ba->Reset(builder->Output(lua_toboolean(L, 3)));
+    lua_settop(L, 2);
+    return 1;
+}
+
+// builder:Reset() starts a new message and keeps the buffer
+static int builder_reset(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    builder->Reset();
+    return 0;
+}
+
+static int builder_head(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_pushinteger(L, builder->head);
+    return 1;
+}
+
+static int builder_offset(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_pushinteger(L, builder->Offset());
+    return 1;
+}
+
+static int builder_pad(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_Integer n = luaL_checkinteger(L, 2);
+    if (n > 0) {
+        luaL_argcheck(L, n <= builder->head, 2, "pad out of range");
+        builder->Pad((uint32_t)n);
+    }
+    return 0;
+}
+
+static int builder_prep(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t size = (uint32_t)luaL_checkinteger(L, 2);
+    uint32_t additionalBytes = (uint32_t)luaL_checkinteger(L, 3);
+    builder_check_grow(L, builder->Prep(size, additionalBytes));
+    return 0;
+}
+
+static int builder_place(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_Integer x = builder_check_value(L, 2);
+    NumType* num_type = check_num_type(L, 3);
+    luaL_argcheck(L, (uint32_t)num_type->bytewidth <= builder->head, 3, "place out of range");
+    builder_place_num(L, builder, num_type, x);
+    return 0;
+}
+
+static int builder_prepend(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    builder_prepend_num(L, builder, num_type, builder_check_value(L, 3));
+    return 0;
+}
+
+// x ~= d, where a nil default always writes the value
+static bool builder_slot_differs(lua_State* L, int x, int d) {
+    if (lua_isnil(L, d)) return !lua_isnil(L, x);
+    return builder_check_value(L, x) != builder_check_value(L, d);
+}
+
+static int builder_prepend_slot(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    uint32_t slot = (uint32_t)luaL_checkinteger(L, 3);
+    if (builder_slot_differs(L, 4, 5)) {
+        builder_check_nested(L, builder);
+        builder_prepend_num(L, builder, num_type, builder_check_value(L, 4));
+        builder->Slot(slot);
+    }
+    return 0;
+}
+
+template<typename T>
+static int builder_prepend_t(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    T x = (T)builder_check_value(L, 2);
+    builder_check_grow(L, builder->Prepend<T>(x));
+    return 0;
+}
+
+template<typename T>
+static int builder_prepend_slot_t(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t slot = (uint32_t)luaL_checkinteger(L, 2);
+    if (builder_slot_differs(L, 3, 4)) {
+        builder_check_nested(L, builder);
+        T x = (T)builder_check_value(L, 3);
+        builder_check_grow(L, builder->Prepend<T>(x));
+        builder->Slot(slot);
+    }
+    return 0;
+}
+
+static int builder_prepend_bool_slot(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t slot = (uint32_t)luaL_checkinteger(L, 2);
+    lua_Integer x = lua_toboolean(L, 3);
+    if (lua_isnil(L, 4) || x != builder_check_value(L, 4)) {
+        builder_check_nested(L, builder);
+        builder_check_grow(L, builder->Prepend<uint8_t>((uint8_t)x));
+        builder->Slot(slot);
+    }
+    return 0;
+}
+
+static void builder_prepend_uoffset(lua_State* L, Builder* builder, lua_Integer off) {
+    builder_check_grow(L, builder->Prep(sizeof(uint32_t), 0));
+    if (off > builder->Offset()) luaL_error(L, "Offset arithmetic error");
+    builder->Place<uint32_t>(builder->Offset() - (uint32_t)off + sizeof(uint32_t));
+}
+
+static int builder_prepend_uoffset_relative(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    builder_prepend_uoffset(L, builder, luaL_checkinteger(L, 2));
+    return 0;
+}
+
+static int builder_prepend_soffset_relative(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_Integer off = luaL_checkinteger(L, 2);
+    builder_check_grow(L, builder->Prep(sizeof(int32_t), 0));
+    if (off > builder->Offset()) return luaL_error(L, "Offset arithmetic error");
+    builder->Place<int32_t>((int32_t)(builder->Offset() - (uint32_t)off + sizeof(int32_t)));
+    return 0;
+}
+
+static int builder_prepend_uoffset_relative_slot(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t slot = (uint32_t)luaL_checkinteger(L, 2);
+    if (builder_slot_differs(L, 3, 4)) {
+        builder_check_nested(L, builder);
+        builder_prepend_uoffset(L, builder, luaL_checkinteger(L, 3));
+        builder->Slot(slot);
+    }
+    return 0;
+}
+
+static int builder_prepend_struct_slot(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t slot = (uint32_t)luaL_checkinteger(L, 2);
+    if (builder_slot_differs(L, 3, 4)) {
+        builder_check_nested(L, builder);
+        if (luaL_checkinteger(L, 3) != builder->Offset()) {
+            return luaL_error(L, "Tried to write a Struct at an Offset that is different from the current Offset of the Builder.");
+        }
+        builder->Slot(slot);
+    }
+    return 0;
+}
+
+static int builder_start_object(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_Integer numFields = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, numFields >= 0, 2, "invalid number of fields");
+    builder_check_not_nested(L, builder);
+    builder->StartObject((uint32_t)numFields);
+    return 0;
+}
+
+static int builder_slot(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_Integer slot = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, slot >= 0, 2, "invalid slot");
+    builder_check_nested(L, builder);
+    builder->Slot((uint32_t)slot);
+    return 0;
+}
+
+static int builder_end_object(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    builder_check_nested(L, builder);
+    lua_pushinteger(L, builder->EndObject());
+    return 1;
+}
+
+static int builder_start_vector(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t elemSize = (uint32_t)luaL_checkinteger(L, 2);
+    uint32_t numElements = (uint32_t)luaL_checkinteger(L, 3);
+    uint32_t alignment = (uint32_t)luaL_checkinteger(L, 4);
+    builder_check_not_nested(L, builder);
+    builder_check_grow(L, builder->StartVector(elemSize, numElements, alignment));
+    lua_pushinteger(L, builder->Offset());
+    return 1;
+}
+
+static int builder_end_vector(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    uint32_t vectorNumElements = (uint32_t)luaL_checkinteger(L, 2);
+    builder_check_nested(L, builder);
+    uint32_t offset = builder->EndVector(vectorNumElements);
+    builder_check_grow(L, offset != 0);
+    lua_pushinteger(L, offset);
+    return 1;
+}
+
+static int builder_create_bytes(lua_State* L, bool nullTerminated) {
+    Builder* builder = check_builder(L, 1);
+    SizedString str;
+    str.string = luaL_checklstring(L, 2, &str.size);
+    builder_check_not_nested(L, builder);
+    builder_check_grow(L, builder->CreateString(str, nullTerminated));
+    uint32_t offset = builder->EndVector((uint32_t)str.size);
+    builder_check_grow(L, offset != 0);
+    lua_pushinteger(L, offset);
+    return 1;
+}
+
+static int builder_create_string(lua_State* L) {
+    return builder_create_bytes(L, true);
+}
+
+static int builder_create_byte_vector(lua_State* L) {
+    return builder_create_bytes(L, false);
+}
+
+// Bulk vector ops: a whole vector is packed from a Lua array in one call, replacing the
+// StartVector + Prepend loop + EndVector sequence of the generated Pack functions.
+
+// converts the value on top of the stack, fixed numbers go through math.value64
+static lua_Integer builder_check_element(lua_State* L, lua_Integer i, bool fixed) {
+    if (lua_isboolean(L, -1)) return lua_toboolean(L, -1);
+    int isnum = 0;
+    lua_Integer x = fixed ? to_value64(lua_tonumberx(L, -1, &isnum)) : lua_tointegerx(L, -1, &isnum);
+    if (!isnum) luaL_error(L, "bad vector element #%d (number expected, got %s)", (int)i, luaL_typename(L, -1));
+    return x;
+}
+
+// prepares a vector of n elements and returns where the first one goes
+static char* builder_start_bulk_vector(lua_State* L, Builder* builder, uint32_t elemSize, uint32_t n, uint32_t alignment) {
+    builder_check_not_nested(L, builder);
+    builder_check_grow(L, (uint64_t)elemSize * n < MAX_BUFFER_SIZE);
+    builder_check_grow(L, builder->StartVector(elemSize, n, alignment));
+    builder->head -= elemSize * n;
+    return builder->data.data() + builder->head;
+}
+
+// builder:CreateNumberVector(N.X, array [, fixed]), returns the vector offset
+static int builder_create_number_vector(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    NumType* num_type = check_num_type(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    bool fixed = lua_toboolean(L, 4) != 0;
+    uint32_t n = (uint32_t)lua_rawlen(L, 3);
+    uint32_t width = num_type->bytewidth;
+    char* p = builder_start_bulk_vector(L, builder, width, n, width);
+    for (uint32_t i = 1; i <= n; ++i) {
+        lua_rawgeti(L, 3, i);
+        write_scalar(p, width, builder_check_element(L, i, fixed));
+        lua_pop(L, 1);
+        p += width;
+    }
+    uint32_t offset = builder->EndVector(n);
+    builder_check_grow(L, offset != 0);
+    lua_pushinteger(L, offset);
+    return 1;
+}
+
+struct StructMember {
+    const char* name;
+    uint32_t offset;
+    int bytewidth;
+    bool fixed;
+};
+
+// builder:CreateStructVector(array, { { "x", N.Int64, true }, { "y", N.Int64, true } })
+// packs a vector of structs made only of scalars, laid out the way flatc lays out the struct;
+// the elements may be tables or userdata with an __index, such as vector2
+static int builder_create_struct_vector(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checktype(L, 3, LUA_TTABLE);
+
+    std::vector<StructMember> members((size_t)lua_rawlen(L, 3));
+    uint32_t size = 0;
+    uint32_t alignment = 1;
+    for (size_t i = 0; i < members.size(); ++i) {
+        StructMember& member = members[i];
+        luaL_argcheck(L, lua_rawgeti(L, 3, (lua_Integer)i + 1) == LUA_TTABLE, 3, "member descriptor expected");
+        lua_rawgeti(L, -1, 1);
+        member.name = lua_tostring(L, -1);
+        luaL_argcheck(L, member.name != nullptr, 3, "member name expected");
+        lua_rawgeti(L, -2, 2);
+        member.bytewidth = check_num_type(L, lua_gettop(L))->bytewidth;
+        lua_rawgeti(L, -3, 3);
+        member.fixed = lua_toboolean(L, -1) != 0;
+        lua_pop(L, 4); // the name stays alive in the descriptor table
+
+        uint32_t width = (uint32_t)member.bytewidth;
+        size = (size + width - 1) & ~(width - 1);
+        member.offset = size;
+        size += width;
+        if (width > alignment) alignment = width;
+    }
+    size = (size + alignment - 1) & ~(alignment - 1);
+    luaL_argcheck(L, size > 0, 3, "struct has no members");
+
+    uint32_t n = (uint32_t)lua_rawlen(L, 2);
+    char* p = builder_start_bulk_vector(L, builder, size, n, alignment);
+    memset(p, 0, (size_t)size * n);
+    for (uint32_t i = 1; i <= n; ++i) {
+        lua_rawgeti(L, 2, i);
+        for (const StructMember& member : members) {
+            lua_getfield(L, -1, member.name);
+            write_scalar(p + member.offset, member.bytewidth, builder_check_element(L, i, member.fixed));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+        p += size;
+    }
+    uint32_t offset = builder->EndVector(n);
+    builder_check_grow(L, offset != 0);
+    lua_pushinteger(L, offset);
+    return 1;
+}
+
+static int builder_finish_impl(lua_State* L, bool sizePrefix) {
+    Builder* builder = check_builder(L, 1);
+    lua_Integer rootTable = luaL_checkinteger(L, 2);
+    uint32_t prepSize = sizeof(uint32_t);
+    if (sizePrefix) prepSize += sizeof(int32_t);
+    builder_check_grow(L, builder->Prep(builder->minalign, prepSize));
+    builder_prepend_uoffset(L, builder, rootTable);
+    if (sizePrefix) {
+        builder_check_grow(L, builder->Prepend<int32_t>((int32_t)builder->Offset()));
+    }
+    builder->finished = true;
+    lua_pushinteger(L, builder->head);
+    return 1;
+}
+
+static int builder_finish(lua_State* L) {
+    return builder_finish_impl(L, false);
+}
+
+static int builder_finish_size_prefixed(lua_State* L) {
+    return builder_finish_impl(L, true);
+}
+
+// returns how many vtables were shared with an earlier identical one, and the bytes that saved
+static int builder_vtable_stats(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    lua_pushinteger(L, builder->dedupedVtables);
+    lua_pushinteger(L, builder->dedupedVtableBytes);
+    return 2;
+}
+
+static int builder_gc(lua_State* L) {
+    Builder* builder = check_builder(L, 1);
+    builder->Trim();
+    builderPool.Give(builder, builder->data.size());
+    return 0;
+}
+
+static void register_builder(lua_State* L) {
+    luaL_Reg builder_reg[] = {
+        { "Output", builder_output },
+        { "OutputTo", builder_output_to },
+        { "Reset", builder_reset },
+        { "Head", builder_head },
+        { "Offset", builder_offset },
+        { "Pad", builder_pad },
+        { "Prep", builder_prep },
+        { "Place", builder_place },
+        { "Prepend", builder_prepend },
+        { "PrependSlot", builder_prepend_slot },
+        { "PrependBool", builder_prepend_t<uint8_t> },
+        { "PrependByte", builder_prepend_t<uint8_t> },
+        { "PrependUint8", builder_prepend_t<uint8_t> },
+        { "PrependUint16", builder_prepend_t<uint16_t> },
+        { "PrependUint32", builder_prepend_t<uint32_t> },
+        { "PrependUint64", builder_prepend_t<uint64_t> },
+        { "PrependInt8", builder_prepend_t<int8_t> },
+        { "PrependInt16", builder_prepend_t<int16_t> },
+        { "PrependInt32", builder_prepend_t<int32_t> },
+        { "PrependInt64", builder_prepend_t<int64_t> },
+        { "PrependVOffsetT", builder_prepend_t<uint16_t> },
+        { "PrependBoolSlot", builder_prepend_bool_slot },
+        { "PrependByteSlot", builder_prepend_slot_t<uint8_t> },
+        { "PrependUint8Slot", builder_prepend_slot_t<uint8_t> },
+        { "PrependUint16Slot", builder_prepend_slot_t<uint16_t> },
+        { "PrependUint32Slot", builder_prepend_slot_t<uint32_t> },
+        { "PrependUint64Slot", builder_prepend_slot_t<uint64_t> },
+        { "PrependInt8Slot", builder_prepend_slot_t<int8_t> },
+        { "PrependInt16Slot", builder_prepend_slot_t<int16_t> },
+        { "PrependInt32Slot", builder_prepend_slot_t<int32_t> },
+        { "PrependInt64Slot", builder_prepend_slot_t<int64_t> },
+        { "PrependUOffsetTRelative", builder_prepend_uoffset_relative },
+        { "PrependSOffsetTRelative", builder_prepend_soffset_relative },
+        { "PrependUOffsetTRelativeSlot", builder_prepend_uoffset_relative_slot },
+        { "PrependStructSlot", builder_prepend_struct_slot },
+        { "StartObject", builder_start_object },
+        { "Slot", builder_slot },
+        { "EndObject", builder_end_object },
+        { "StartVector", builder_start_vector },
+        { "EndVector", builder_end_vector },
+        { "CreateString", builder_create_string },
+        { "CreateByteVector", builder_create_byte_vector },
+        { "CreateNumberVector", builder_create_number_vector },
+        { "CreateStructVector", builder_create_struct_vector },
+        { "Finish", builder_finish },
+        { "FinishSizePrefixed", builder_finish_size_prefixed },
+        { "VtableStats", builder_vtable_stats },
+        { "__gc", builder_gc },
+        { nullptr, nullptr }
+    };
+
+    luaL_newmetatable(L, "builder_mt");
+    set_funcs(L, builder_reg);
+    lua_setfield(L, -1, "__index");
+}
+
+static uint32_t schema_get_integer(lua_State* L, int desc, const char* key, uint32_t def) {
+    lua_getfield(L, desc, key);
+    uint32_t ret = lua_isnil(L, -1) ? def : (uint32_t)luaL_checkinteger(L, -1);
+    lua_pop(L, 1);
+    return ret;
+}
+
+static std::string schema_get_string(lua_State* L, int desc, const char* key) {
+    lua_getfield(L, desc, key);
+    std::string ret = lua_isnil(L, -1) ? "" : luaL_checkstring(L, -1);
+    lua_pop(L, 1);
+    return ret;
+}
+
+static bool schema_scalar_type(const char* name, ScalarType* scalar) {
+    for (int i = 0; i < (int)ScalarType::Count; ++i) {
+        if (strcmp(name, SCALAR_TYPE_NAMES[i]) == 0) {
+            *scalar = (ScalarType)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t schema_compile_object(lua_State* L, Schema* schema, int desc, int memo);
+
+// parses a type name ("Int32", "struct", "string", "table"), field holds the descriptor at the stack top
+static FieldType schema_compile_type(lua_State* L, Schema* schema, SchemaField* field, const char* type, int memo) {
+    if (schema_scalar_type(type, &field->scalar)) return FieldType::Scalar;
+    if (strcmp(type, "string") == 0) return FieldType::String;
+    if (strcmp(type, "struct") == 0 || strcmp(type, "table") == 0) {
+        if (lua_getfield(L, -1, "ref") != LUA_TTABLE) luaL_error(L, "field '%s': ref expected", field->name.c_str());
+        field->ref = schema_compile_object(L, schema, lua_gettop(L), memo);
+        lua_pop(L, 1);
+        bool isStruct = schema->objects[field->ref].isStruct;
+        if (isStruct != (strcmp(type, "struct") == 0)) luaL_error(L, "field '%s': ref is not a %s", field->name.c_str(), type);
+        return isStruct ? FieldType::Struct : FieldType::Table;
+    }
+    luaL_error(L, "field '%s': unknown type '%s'", field->name.c_str(), type);
+    return FieldType::Deprecated;
+}
+
+static uint32_t schema_compile_object(lua_State* L, Schema* schema, int desc, int memo) {
+    lua_pushvalue(L, desc);
+    if (lua_rawget(L, memo) == LUA_TNUMBER) {
+        uint32_t ref = (uint32_t)lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        return ref;
+    }
+    lua_pop(L, 1);
+
+    // register before the fields so that tables can refer to themselves
+    uint32_t ref = (uint32_t)schema->objects.size();
+    schema->objects.emplace_back();
+    lua_pushvalue(L, desc);
+    lua_pushinteger(L, ref);
+    lua_rawset(L, memo);
+
+    SchemaObject object;
+    object.name = schema_get_string(L, desc, "name");
+    lua_getfield(L, desc, "struct");
+    object.isStruct = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    if (object.isStruct) {
+        object.size = schema_get_integer(L, desc, "size", 0);
+        object.align = schema_get_integer(L, desc, "align", 1);
+        if (object.align == 0 || (object.align & (object.align - 1)) != 0 || object.size % object.align != 0) {
+            luaL_error(L, "'%s': invalid struct size or alignment", object.name.c_str());
+        }
+    }
+
+    if (lua_getfield(L, desc, "fields") != LUA_TTABLE) luaL_error(L, "'%s': fields expected", object.name.c_str());
+    lua_Integer count = (lua_Integer)lua_rawlen(L, -1);
+    for (lua_Integer i = 1; i <= count; ++i) {
+        luaL_checkstack(L, 8, "schema too deep");
+        lua_rawgeti(L, -1, i);
+        int fieldDesc = lua_gettop(L);
+        luaL_checktype(L, fieldDesc, LUA_TTABLE);
+
+        SchemaField field;
+        field.name = schema_get_string(L, fieldDesc, "name");
+        uint32_t slot = schema_get_integer(L, fieldDesc, "slot", (uint32_t)(i - 1));
+        field.offset = schema_get_integer(L, fieldDesc, "offset", 0);
+        lua_getfield(L, fieldDesc, "fixed");
+        field.fixed = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+        std::string type = schema_get_string(L, fieldDesc, "type");
+        if (type == "vector") {
+            field.type = FieldType::Vector;
+            field.element = schema_compile_type(L, schema, &field, schema_get_string(L, fieldDesc, "element").c_str(), memo);
+        } else {
+            field.type = schema_compile_type(L, schema, &field, type.c_str(), memo);
+        }
+        if (object.isStruct && (field.type != FieldType::Scalar && field.type != FieldType::Struct)) {
+            luaL_error(L, "'%s': struct members must be scalars or structs", object.name.c_str());
+        }
+        if (object.isStruct) {
+            // the encoder reads members straight from verified buffers, so they must lie inside the struct
+            uint32_t width = schema->InlineSize(field.type, field);
+            uint32_t align = field.type == FieldType::Struct ? schema->objects[field.ref].align : width;
+            if ((uint64_t)field.offset + width > object.size || field.offset % align != 0) {
+                luaL_error(L, "'%s': member '%s' is out of the struct or misaligned", object.name.c_str(), field.name.c_str());
+            }
+        }
+
+        if (object.isStruct) {
+            object.fields.push_back(field);
+        } else {
+            if (slot >= object.fields.size()) object.fields.resize(slot + 1);
+            object.fields[slot] = field;
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    schema->objects[ref] = std::move(object);
+    return ref;
+}
+
+// new_schema(desc) compiles a schema descriptor, desc describes the root table:
+//   { name = "TestData", fields = {
+//       { name = "entity", type = "Int32" },                          -- slot 0, "slot" overrides
+//       { name = "someStruct", type = "struct", ref = SomeStruct },
+//       { name = "someObj", type = "table", ref = SomethingElse },
+//       { name = "str", type = "string" },
+//       { name = "intArray", type = "vector", element = "Int32" },
+//       { name = "someFix64", type = "Int64", fixed = true },          -- stored with math.value64
+//       { name = "someArray", type = "vector", element = "struct", ref = SomeStruct } } }
+// and structs list their members with offsets:
+//   { name = "SomeStruct", struct = true, size = 16, align = 8, fields = {
+//       { name = "someField", type = "Int32", offset = 0 },
+//       { name = "nestedStruct", type = "struct", ref = NestedStruct, offset = 8 } } }
+static int schema_new(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    Schema** udata = (Schema**)lua_newuserdata(L, sizeof(Schema*));
+    *udata = new Schema();
+    lua_pushvalue(L, lua_upvalueindex(UPVALUE_SCHEMA_MT));
+    lua_setmetatable(L, -2);
+
+    lua_newtable(L); // [schema, memo]
+    (*udata)->root = schema_compile_object(L, *udata, 1, lua_gettop(L));
+    if ((*udata)->objects[(*udata)->root].isStruct) return luaL_argerror(L, 1, "root must be a table");
+    lua_pop(L, 1);
+    return 1;
+}
+
+static int schema_gc(lua_State* L) {
+    Schema* schema = check_schema(L, 1);
+    delete schema;
+    return 0;
+}
+
+static void register_schema(lua_State* L) {
+    luaL_Reg schema_reg[] = {
+        { "__gc", schema_gc },
+        { nullptr, nullptr }
+    };
+
+    luaL_newmetatable(L, "schema_mt");
+    set_funcs(L, schema_reg);
+    lua_setfield(L, -1, "__index");
+}
+
+// verify(ba, schema [, { max_depth = 64, max_tables = 1000000 }]), returns true or false and a message.
+// On success the binary array is flagged as verified with this schema, see ba:IsVerified.
+// Fields the schema leaves out are not checked, and views range check their reads either way.
+static int verify(lua_State* L) {
+    BinaryArray* ba = check_binaryarray(L, 1);
+    Schema* schema = check_schema(L, 2);
+    uint32_t maxDepth = DEFAULT_MAX_DEPTH;
+    uint32_t maxTables = DEFAULT_MAX_TABLES;
+    if (!lua_isnoneornil(L, 3)) {
+        luaL_checktype(L, 3, LUA_TTABLE);
+        maxDepth = schema_get_integer(L, 3, "max_depth", maxDepth);
+        maxTables = schema_get_integer(L, 3, "max_tables", maxTables);
+    }
+
+    Verifier verifier(ba, schema, maxDepth, maxTables);
+    ba->verified = verifier.VerifyBuffer();
+    ba->verifiedSchema = schema->id;
+    lua_pushboolean(L, ba->verified);
+    if (ba->verified) return 1;
+    lua_pushstring(L, verifier.error);
+    return 2;
+}
+
+#if ENABLE_LUA_RAPIDJSON
+
+// Fixed point fields hold 32.32 raw values (math.value64). They are converted to and from decimals
+// exactly here, 10 fractional digits are enough for every raw value to survive a round trip.
+static const uint32_t FIXED_FRACTION_DIGITS = 10;
+
+static size_t json_format_fixed(char* buff, int64_t raw) {
+    uint64_t magnitude = raw < 0 ? 0 - (uint64_t)raw : (uint64_t)raw;
+    uint64_t integer = magnitude >> 32;
+    uint64_t fraction = magnitude & 0xffffffffull;
+    char digits[FIXED_FRACTION_DIGITS];
+    for (uint32_t i = 0; i < FIXED_FRACTION_DIGITS; ++i) {
+        fraction *= 10;
+        digits[i] = (char)(fraction >> 32);
+        fraction &= 0xffffffffull;
+    }
+    if (fraction >= 0x80000000ull) { // round the last digit, carrying into the integer part
+        uint32_t i = FIXED_FRACTION_DIGITS;
+        while (i > 0 && ++digits[i - 1] == 10) digits[--i] = 0;
+        if (i == 0) integer++;
+    }
+    uint32_t n = FIXED_FRACTION_DIGITS;
+    while (n > 0 && digits[n - 1] == 0) n--;
+
+    char* p = buff;
+    if (raw < 0 && (integer != 0 || n != 0)) *p++ = '-';
+    p += snprintf(p, 24, "%llu", (unsigned long long)integer);
+    if (n > 0) {
+        *p++ = '.';
+        for (uint32_t i = 0; i < n; ++i) *p++ = (char)('0' + digits[i]);
+    }
+    return (size_t)(p - buff);
+}
+
+// accepts [-]digits[.digits], returns false on anything else or when the value does not fit
+static bool json_parse_fixed(const char* str, size_t length, int64_t* raw) {
+    const char* end = str + length;
+    bool negative = str < end && *str == '-';
+    if (negative) str++;
+    if (str == end || *str < '0' || *str > '9') return false;
+    uint64_t integer = 0;
+    for (; str < end && *str >= '0' && *str <= '9'; ++str) {
+        integer = integer * 10 + (uint64_t)(*str - '0');
+        if (integer > 0x80000000ull) return false;
+    }
+
+    // keep up to 18 fractional digits and convert them bit by bit, rounding to nearest
+    uint64_t fraction = 0;
+    uint64_t scale = 1;
+    if (str < end && *str == '.') {
+        ++str;
+        if (str == end) return false;
+        for (; str < end && *str >= '0' && *str <= '9'; ++str) {
+            if (scale < 1000000000000000000ull) {
+                fraction = fraction * 10 + (uint64_t)(*str - '0');
+                scale *= 10;
+            }
+        }
+    }
+    if (str != end) return false;
+    uint64_t bits = 0;
+    for (int i = 0; i < 32; ++i) {
+        fraction *= 2;
+        bits <<= 1;
+        if (fraction >= scale) {
+            fraction -= scale;
+            bits |= 1;
+        }
+    }
+    if (fraction * 2 >= scale && scale > 1) bits++;
+
+    uint64_t magnitude = (integer << 32) + bits;
+    if (magnitude > (negative ? 0x8000000000000000ull : 0x7fffffffffffffffull)) return false;
+    *raw = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+// Streams a verified buffer through a rapidjson writer in slot order, no Lua value is created.
+template<typename Writer>
+class JsonEncoder {
+public:
+    JsonEncoder(BinaryArray* binaryArray, Schema* schema, Writer& writer, bool fixedDecimal)
+        : binaryArray(binaryArray), schema(schema), writer(writer), fixedDecimal(fixedDecimal) {}
+
+    void EncodeBuffer() {
+        WriteTable(Indirect(0), schema->root);
+    }
+
+private:
+    template<typename T>
+    T Read(uint32_t offset) {
+        T ret;
+        memcpy(&ret, binaryArray->base + offset, sizeof(T));
+        return ret;
+    }
+
+    uint32_t Indirect(uint32_t offset) {
+        return offset + Read<uint32_t>(offset);
+    }
+
+    void WriteKey(const SchemaField& field) {
+        writer.Key(field.name.c_str(), (rapidjson::SizeType)field.name.size());
+    }
+
+    void WriteScalar(const SchemaField& field, uint32_t offset) {
+        lua_Integer x = read_scalar(field.scalar, binaryArray->base + offset);
+        if (field.fixed && fixedDecimal) {
+            char buff[48];
+            writer.RawValue(buff, json_format_fixed(buff, (int64_t)x), rapidjson::kNumberType);
+            return;
+        }
+        switch (field.scalar) {
+        case ScalarType::Bool: writer.Bool(x != 0); break;
+        case ScalarType::Uint64: writer.Uint64((uint64_t)x); break;
+        default: writer.Int64((int64_t)x); break;
+        }
+    }
+
+    void WriteStruct(uint32_t ref, uint32_t position) {
+        writer.StartObject();
+        for (const SchemaField& field : schema->objects[ref].fields) {
+            WriteKey(field);
+            if (field.type == FieldType::Struct) WriteStruct(field.ref, position + field.offset);
+            else WriteScalar(field, position + field.offset);
+        }
+        writer.EndObject();
+    }
+
+    void WriteVector(const SchemaField& field, uint32_t position) {
+        uint32_t length = Read<uint32_t>(position);
+        uint32_t elemSize = schema->InlineSize(field.element, field);
+        uint32_t elem = position + sizeof(uint32_t);
+        writer.StartArray();
+        for (uint32_t i = 0; i < length; ++i, elem += elemSize) {
+            WriteValue(field.element, field, elem);
+        }
+        writer.EndArray();
+    }
+
+    void WriteValue(FieldType type, const SchemaField& field, uint32_t offset) {
+        switch (type) {
+        case FieldType::Scalar: WriteScalar(field, offset); break;
+        case FieldType::Struct: WriteStruct(field.ref, offset); break;
+        case FieldType::String: {
+            uint32_t position = Indirect(offset);
+            writer.String(binaryArray->base + position + sizeof(uint32_t), (rapidjson::SizeType)Read<uint32_t>(position));
+            break;
+        }
+        case FieldType::Table: WriteTable(Indirect(offset), field.ref); break;
+        case FieldType::Vector: WriteVector(field, Indirect(offset)); break;
+        default: writer.Null(); break;
+        }
+    }
+
+    void WriteTable(uint32_t position, uint32_t ref) {
+        const SchemaObject& object = schema->objects[ref];
+        uint32_t vtable = position - Read<int32_t>(position);
+        uint32_t vtableSize = Read<uint16_t>(vtable);
+        size_t slots = (vtableSize - 2 * sizeof(uint16_t)) / sizeof(uint16_t);
+        if (slots > object.fields.size()) slots = object.fields.size();
+        writer.StartObject();
+        for (size_t slot = 0; slot < slots; ++slot) {
+            uint32_t fieldOffset = Read<uint16_t>(vtable + (uint32_t)((slot + 2) * sizeof(uint16_t)));
+            const SchemaField& field = object.fields[slot];
+            if (fieldOffset == 0 || field.type == FieldType::Deprecated) continue;
+            WriteKey(field);
+            WriteValue(field.type, field, position + fieldOffset);
+        }
+        writer.EndObject();
+    }
+
+    BinaryArray* binaryArray;
+    Schema* schema;
+    Writer& writer;
+    bool fixedDecimal;
+};
+
+struct JsonPendingField {
+    uint32_t slot;
+    uint32_t size; // 0 for offsets
+    uint32_t align;
+    uint32_t value; // the offset, or where the inline bytes start in JsonFrame::bytes
+};
+
+struct JsonFrame {
+    FieldType type = FieldType::Table; // Table, Struct or Vector
+    const SchemaObject* object = nullptr; // tables and structs
+    const SchemaField* field = nullptr; // vectors, the field holding the vector
+    const SchemaField* key = nullptr; // tables and structs, the field the next value goes to
+    uint32_t count = 0; // vectors
+    uint32_t next = 0; // tables and structs, where the next key lookup starts
+    std::vector<char> bytes; // struct image, table inline values or vector elements
+    std::vector<uint32_t> offsets; // vectors of strings or tables
+    std::vector<JsonPendingField> fields; // tables
+};
+
+// Builds a buffer straight from rapidjson SAX events. A table is held back until its closing
+// brace, by then all of its children are in the builder and it is written in one go, the same
+// bottom-up order the generated Pack functions follow.
+class JsonDecoder : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JsonDecoder> {
+public:
+    JsonDecoder(Builder* builder, Schema* schema, bool fixedDecimal, uint32_t maxDepth)
+        : builder(builder), schema(schema), fixedDecimal(fixedDecimal), maxDepth(maxDepth) {}
+
+    bool Finish() {
+        if (!hasRoot) return Fail("root table expected");
+        if (!builder->Prep(builder->minalign, sizeof(uint32_t)) || !builder->PrependUOffsetRelative(root)) return Grow();
+        builder->finished = true;
+        return true;
+    }
+
+    bool Default() {
+        return Fail("unexpected value");
+    }
+
+    bool Null() {
+        if (depth == 0 || frames[depth - 1].type != FieldType::Table) return Fail("unexpected null");
+        frames[depth - 1].key = nullptr; // absent field
+        return true;
+    }
+
+    bool Bool(bool b) {
+        const SchemaField* field;
+        FieldType type;
+        if (!Target(&field, &type)) return false;
+        if (type != FieldType::Scalar) return Fail("boolean not expected");
+        return AcceptScalar(*field, b ? 1 : 0);
+    }
+
+    bool RawNumber(const char* str, rapidjson::SizeType length, bool) {
+        const SchemaField* field;
+        FieldType type;
+        if (!Target(&field, &type)) return false;
+        if (type != FieldType::Scalar) return Fail("number not expected");
+
+        if (field->fixed && fixedDecimal) {
+            int64_t raw;
+            if (!json_parse_fixed(str, length, &raw)) return Fail("fixed point decimal expected");
+            return AcceptScalar(*field, (lua_Integer)raw);
+        }
+
+        char buff[64];
+        if (length >= sizeof(buff)) return Fail("number too long");
+        memcpy(buff, str, length);
+        buff[length] = '\0';
+        char* end = nullptr;
+        errno = 0;
+        lua_Integer x;
+        if (field->scalar == ScalarType::Uint64) {
+            if (buff[0] == '-') return Fail("value out of range");
+            x = (lua_Integer)strtoull(buff, &end, 10);
+        } else {
+            x = (lua_Integer)strtoll(buff, &end, 10);
+        }
+        if (end != buff + length) return Fail("integer expected");
+        if (errno == ERANGE || !InRange(field->scalar, x)) return Fail("value out of range");
+        return AcceptScalar(*field, x);
+    }
+
+    bool String(const char* str, rapidjson::SizeType length, bool) {
+        const SchemaField* field;
+        FieldType type;
+        if (!Target(&field, &type)) return false;
+        if (type != FieldType::String) return Fail("string not expected");
+        if (!builder->CreateString(SizedString{ length, str }, true)) return Grow();
+        uint32_t offset = builder->EndVector(length);
+        if (offset == 0) return Grow();
+        return AcceptOffset(offset);
+    }
+
+    bool StartObject() {
+        if (depth == 0) {
+            if (hasRoot) return Fail("unexpected value");
+            PushFrame(FieldType::Table).object = &schema->objects[schema->root];
+            return true;
+        }
+        const SchemaField* field;
+        FieldType type;
+        if (!Target(&field, &type)) return false;
+        if (depth >= maxDepth) return Fail("nesting too deep");
+        if (type != FieldType::Table && type != FieldType::Struct) return Fail("object not expected");
+        JsonFrame& frame = PushFrame(type);
+        frame.object = &schema->objects[field->ref];
+        if (type == FieldType::Struct) frame.bytes.assign(frame.object->size, 0);
+        return true;
+    }
+
+    bool Key(const char* str, rapidjson::SizeType length, bool) {
+        // keys usually come in schema order (to_json writes them so), start after the last one
+        JsonFrame& frame = frames[depth - 1];
+        const std::vector<SchemaField>& fields = frame.object->fields;
+        for (size_t i = 0, n = fields.size(); i < n; ++i) {
+            size_t index = (frame.next + i) % n;
+            const SchemaField& field = fields[index];
+            if (field.type != FieldType::Deprecated && field.name.size() == length && memcmp(field.name.data(), str, length) == 0) {
+                frame.key = &field;
+                frame.next = (uint32_t)index + 1;
+                return true;
+            }
+        }
+        return Fail("unknown field");
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        JsonFrame& frame = frames[depth - 1];
+        if (frame.type == FieldType::Struct) {
+            depth--;
+            return AcceptBytes(frame.bytes.data(), frame.object->size, frame.object->align);
+        }
+
+        // largest first like flatc, so the fields pack with little padding
+        std::stable_sort(frame.fields.begin(), frame.fields.end(), [](const JsonPendingField& a, const JsonPendingField& b) {
+            return (a.size != 0 ? a.size : sizeof(uint32_t)) > (b.size != 0 ? b.size : sizeof(uint32_t));
+        });
+        builder->StartObject((uint32_t)frame.object->fields.size());
+        for (const JsonPendingField& field : frame.fields) {
+            if (field.size == 0) {
+                if (!builder->PrependUOffsetRelative(field.value)) return Grow();
+            } else {
+                if (!builder->Prep(field.align, field.size)) return Grow();
+                builder->head -= field.size;
+                memcpy(builder->data.data() + builder->head, frame.bytes.data() + field.value, field.size);
+            }
+            builder->Slot(field.slot);
+        }
+        uint32_t offset = builder->EndObject();
+
+        depth--;
+        if (depth == 0) {
+            root = offset;
+            hasRoot = true;
+            return true;
+        }
+        return AcceptOffset(offset);
+    }
+
+    bool StartArray() {
+        if (depth == 0) return Fail("root table expected");
+        const SchemaField* field;
+        FieldType type;
+        if (!Target(&field, &type)) return false;
+        if (depth >= maxDepth) return Fail("nesting too deep");
+        if (type != FieldType::Vector) return Fail("array not expected");
+        PushFrame(type).field = field;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType) {
+        JsonFrame& frame = frames[depth - 1];
+        const SchemaField& field = *frame.field;
+        uint32_t n = frame.count;
+        if (field.element == FieldType::String || field.element == FieldType::Table) {
+            if (!builder->StartVector(sizeof(uint32_t), n, sizeof(uint32_t))) return Grow();
+            for (uint32_t i = n; i > 0; --i) {
+                if (!builder->PrependUOffsetRelative(frame.offsets[i - 1])) return Grow();
+            }
+        } else {
+            uint32_t elemSize = schema->InlineSize(field.element, field);
+            uint32_t align = field.element == FieldType::Struct ? schema->objects[field.ref].align : elemSize;
+            if (frame.bytes.size() >= MAX_BUFFER_SIZE || !builder->StartVector(elemSize, n, align)) return Grow();
+            builder->head -= (uint32_t)frame.bytes.size();
+            memcpy(builder->data.data() + builder->head, frame.bytes.data(), frame.bytes.size());
+        }
+        uint32_t offset = builder->EndVector(n);
+        if (offset == 0) return Grow();
+        depth--;
+        return AcceptOffset(offset);
+    }
+
+    const char* error = nullptr;
+
+private:
+    bool Fail(const char* message) {
+        if (error == nullptr) error = message;
+        return false;
+    }
+
+    bool Grow() {
+        return Fail("Flat Buffers cannot grow buffer beyond 2 gigabytes");
+    }
+
+    static bool InRange(ScalarType type, lua_Integer x) {
+        switch (type) {
+        case ScalarType::Bool: return x == 0 || x == 1;
+        case ScalarType::Uint8: return x >= 0 && x <= UINT8_MAX;
+        case ScalarType::Uint16: return x >= 0 && x <= UINT16_MAX;
+        case ScalarType::Uint32: return x >= 0 && x <= UINT32_MAX;
+        case ScalarType::Int8: return x >= INT8_MIN && x <= INT8_MAX;
+        case ScalarType::Int16: return x >= INT16_MIN && x <= INT16_MAX;
+        case ScalarType::Int32: return x >= INT32_MIN && x <= INT32_MAX;
+        default: return true;
+        }
+    }
+
+    // frames are reused between objects, so their buffers keep their capacity
+    JsonFrame& PushFrame(FieldType type) {
+        if (depth == frames.size()) frames.emplace_back();
+        JsonFrame& frame = frames[depth++];
+        frame.type = type;
+        frame.key = nullptr;
+        frame.count = 0;
+        frame.next = 0;
+        frame.bytes.clear();
+        frame.offsets.clear();
+        frame.fields.clear();
+        return frame;
+    }
+
+    // the field the next value belongs to, and its type (the element type inside a vector)
+    bool Target(const SchemaField** field, FieldType* type) {
+        if (depth == 0) return Fail("root table expected");
+        JsonFrame& frame = frames[depth - 1];
+        if (frame.type == FieldType::Vector) {
+            *field = frame.field;
+            *type = frame.field->element;
+        } else {
+            *field = frame.key;
+            *type = frame.key->type;
+        }
+        return true;
+    }
+
+    bool AcceptScalar(const SchemaField& field, lua_Integer x) {
+        char buff[sizeof(uint64_t)];
+        uint32_t size = SCALAR_TYPE_SIZES[(int)field.scalar];
+        write_scalar(buff, (int)size, x);
+        return AcceptBytes(buff, size, size);
+    }
+
+    // hands an inline value (a scalar or a finished struct) to the enclosing frame
+    bool AcceptBytes(const char* bytes, uint32_t size, uint32_t align) {
+        JsonFrame& frame = frames[depth - 1];
+        switch (frame.type) {
+        case FieldType::Vector:
+            frame.bytes.insert(frame.bytes.end(), bytes, bytes + size);
+            frame.count++;
+            break;
+        case FieldType::Struct:
+            if (frame.key->offset + size > frame.bytes.size()) return Fail("struct member out of struct");
+            memcpy(frame.bytes.data() + frame.key->offset, bytes, size);
+            break;
+        default:
+            frame.fields.push_back({ (uint32_t)(frame.key - frame.object->fields.data()), size, align, (uint32_t)frame.bytes.size() });
+            frame.bytes.insert(frame.bytes.end(), bytes, bytes + size);
+            break;
+        }
+        frame.key = nullptr;
+        return true;
+    }
+
+    // hands the offset of a finished string, table or vector to the enclosing frame
+    bool AcceptOffset(uint32_t offset) {
+        JsonFrame& frame = frames[depth - 1];
+        switch (frame.type) {
+        case FieldType::Vector:
+            frame.offsets.push_back(offset);
+            frame.count++;
+            break;
+        case FieldType::Table:
+            frame.fields.push_back({ (uint32_t)(frame.key - frame.object->fields.data()), 0, sizeof(uint32_t), offset });
+            break;
+        default:
+            return Fail("offset not expected");
+        }
+        frame.key = nullptr;
+        return true;
+    }
+
+    Builder* builder;
+    Schema* schema;
+    bool fixedDecimal;
+    uint32_t maxDepth;
+    std::vector<JsonFrame> frames;
+    size_t depth = 0;
+    uint32_t root = 0;
+    bool hasRoot = false;
+};
+
+static bool json_get_option(lua_State* L, int n, const char* key) {
+    if (lua_isnoneornil(L, n)) return false;
+    luaL_checktype(L, n, LUA_TTABLE);
+    lua_getfield(L, n, key);
+    bool ret = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+    return ret;
+}
+
+// to_json(ba, schema [, { pretty = false, fixed_decimal = false }]), returns the JSON text or nil and a message.
+// A buffer not yet verified against this schema is verified first. fixed_decimal prints the fields marked fixed as decimals,
+// otherwise they are printed raw, as math.value64 returns them.
+static int to_json(lua_State* L) {
+    BinaryArray* ba = check_binaryarray(L, 1);
+    Schema* schema = check_schema(L, 2);
+    bool pretty = json_get_option(L, 3, "pretty");
+    bool fixedDecimal = json_get_option(L, 3, "fixed_decimal");
+    if (!ba->verified || ba->verifiedSchema != schema->id) {
+        Verifier verifier(ba, schema, DEFAULT_MAX_DEPTH, DEFAULT_MAX_TABLES);
+        ba->verified = verifier.VerifyBuffer();
+        ba->verifiedSchema = schema->id;
+        if (!ba->verified) {
+            lua_pushnil(L);
+            lua_pushstring(L, verifier.error);
+            return 2;
+        }
+    }
+
+    rapidjson::StringBuffer buffer;
+    if (pretty) {
+        rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+        JsonEncoder<rapidjson::PrettyWriter<rapidjson::StringBuffer>>(ba, schema, writer, fixedDecimal).EncodeBuffer();
+    } else {
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        JsonEncoder<rapidjson::Writer<rapidjson::StringBuffer>>(ba, schema, writer, fixedDecimal).EncodeBuffer();
+    }
+    lua_pushlstring(L, buffer.GetString(), buffer.GetSize());
+    return 1;
+}
+
+// from_json(json, schema [, { fixed_decimal = false }]), returns the finished buffer as a string,
+// the same as builder:Output(), or nil and a message. Every field present in the JSON is written,
+// null leaves a field absent.
+static int from_json(lua_State* L) {
+    size_t size;
+    const char* json = luaL_checklstring(L, 1, &size);
+    Schema* schema = check_schema(L, 2);
+    bool fixedDecimal = json_get_option(L, 3, "fixed_decimal");
+
+    Builder builder(1024);
+    JsonDecoder decoder(&builder, schema, fixedDecimal, DEFAULT_MAX_DEPTH);
+    rapidjson::MemoryStream stream(json, size);
+    rapidjson::Reader reader;
+    rapidjson::ParseResult result = reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream, decoder);
+    if (result.IsError()) {
+        const char* message = decoder.error != nullptr ? decoder.error : rapidjson::GetParseError_En(result.Code());
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s (at %d)", message, (int)result.Offset());
+        return 2;
+    }
+    if (!decoder.Finish()) {
+        lua_pushnil(L);
+        lua_pushstring(L, decoder.error);
+        return 2;
+    }
+
+    SizedString output = builder.Output(false);
+    lua_pushlstring(L, output.string, output.size);
+    return 1;
+}
+
+#endif
+
+extern "C" {
 
 LUALIB_API int luaopen_flatbuffers(lua_State* L)
 {
+    // create every metatable up front, they are the upvalues of all the functions registered below
+    for (const char* name : UPVALUE_METATABLES) {
+        luaL_newmetatable(L, name);
+        lua_pop(L, 1);
+    }
+
+    register_num_type(L);
     register_binaryarray(L);
     register_view(L);
+    register_builder(L);
+    register_schema(L);
 
 	lua_newtable(L); // [flatbuffers]
 
@@ -506,16 +2682,54 @@ LUALIB_API int luaopen_flatbuffers(lua_State* L)
 	lua_pushliteral(L, "v0.1"); // [flatbuffers, version]
 	lua_setfield(L, -2, "_VERSION"); // [flatbuffers]
 
-	lua_pushcfunction(L, ba_new); // [flatbuffers, new_binaryarray]
+	push_function(L, ba_new); // [flatbuffers, new_binaryarray]
 	lua_setfield(L, -2, "new_binaryarray"); // [flatbuffers]
 
+	push_function(L, ba_borrow); // [flatbuffers, borrow_binaryarray]
+	lua_setfield(L, -2, "borrow_binaryarray"); // [flatbuffers]
+
+	push_function(L, ba_map); // [flatbuffers, map_binaryarray]
+	lua_setfield(L, -2, "map_binaryarray"); // [flatbuffers]
+
 	new_num_types_table(L); // [flatbuffers, num_types]
 	lua_setfield(L, -2, "N"); // [flatbuffers]
 
-	lua_pushcfunction(L, view_new); // [flatbuffers, new_view]
+	push_function(L, view_new); // [flatbuffers, new_view]
 	lua_setfield(L, -2, "new_view"); // [flatbuffers]
 
+	push_function(L, builder_new); // [flatbuffers, new_builder]
+	lua_setfield(L, -2, "new_builder"); // [flatbuffers]
+
+	push_function(L, schema_new); // [flatbuffers, new_schema]
+	lua_setfield(L, -2, "new_schema"); // [flatbuffers]
+
+	push_function(L, verify); // [flatbuffers, verify]
+	lua_setfield(L, -2, "verify"); // [flatbuffers]
+
+#if ENABLE_LUA_RAPIDJSON
+	push_function(L, to_json); // [flatbuffers, to_json]
+	lua_setfield(L, -2, "to_json"); // [flatbuffers]
+
+	push_function(L, from_json); // [flatbuffers, from_json]
+	lua_setfield(L, -2, "from_json"); // [flatbuffers]
+#endif
+
 	return 1;
 }
 
+LUALIB_API void flatbuffers_push_binaryarray(lua_State* L, const char* data, size_t size)
+{
+    SizedString str{ size, data };
+    push_binaryarray(L, new BinaryArray(str, BinaryArrayStorage::Borrowed));
+}
+
+LUALIB_API const char* flatbuffers_builder_output(lua_State* L, int idx, size_t* size)
+{
+    Builder** udata = (Builder**)luaL_testudata(L, idx, "builder_mt");
+    if (udata == nullptr || !(*udata)->finished) return nullptr;
+    SizedString ret = (*udata)->Output(false);
+    *size = ret.size;
+    return ret.string;
+}
+
 }
@@ -0,0 +1,26 @@
+#ifndef __LUA_FLATBUFFERS_H__
+#define __LUA_FLATBUFFERS_H__
+
+#include <stddef.h>
+#include "lua.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Opens the flatbuffersnative module and leaves its table on the stack.
+LUALIB_API int luaopen_flatbuffers(lua_State* L);
+
+// Pushes a read-only binary array over memory owned by the host, nothing is copied.
+// The memory must stay valid for as long as the binary array and its views are reachable.
+LUALIB_API void flatbuffers_push_binaryarray(lua_State* L, const char* data, size_t size);
+
+// Returns the finished bytes of the builder at idx without copying them, for handing straight to a
+// socket send; nullptr when it is not a finished builder. Valid until the builder is changed, reset or collected.
+LUALIB_API const char* flatbuffers_builder_output(lua_State* L, int idx, size_t* size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+-- binary array lifetime checks, run from the test directory: lua binaryarray.lua
+local __g = _G
+
+-- export global variable
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+
+exports.vector2 = vector2_native
+
+local flatbuffers = require("flatbuffers")
+local TestDataT = require("protocol.generated.Test_generated").TestDataT
+local TestData = require("protocol.generated.Test_serializer").TestData
+
+local data = __TS__New(TestDataT)
+data.entity = 42
+data.str = "hello"
+
+local builder = flatbuffers.Builder(1024)
+builder:Finish(TestData.Pack(builder, data))
+local output = builder:Output()
+
+-- a borrowed string is kept alive by the binary array, which its views keep alive in turn
+local function borrowed()
+    local copy = output:sub(1, -2) .. output:sub(-1) -- a fresh string nothing else references
+    return TestData.GetRootAsTestData(flatbuffersnative.borrow_binaryarray(copy), 0)
+end
+local root = borrowed()
+for _ = 1, 3 do collectgarbage() end
+assert(root:Entity() == 42 and root:Str() == "hello")
+assert(root.view.bytes:Slice(0, #output) == output)
+assert(not root.view.bytes:IsVerified())
+assert(not pcall(root.view.bytes.Set, root.view.bytes, "x", 0))
+
+-- only strings can be borrowed, raw pointers are for native hosts (flatbuffers_push_binaryarray)
+assert(not pcall(flatbuffersnative.borrow_binaryarray, 12))
+
+-- new_binaryarray copies, so it is writable and independent of its string
+local ba = flatbuffersnative.new_binaryarray(output)
+ba:Set("\255", 0)
+assert(ba:Slice(0, #output) ~= output)
+
+-- a mapped file stays readable after the file is removed and the path is gone
+local path = os.tmpname()
+local f = assert(io.open(path, "wb"))
+f:write(output)
+f:close()
+local mapped = flatbuffersnative.map_binaryarray(path)
+os.remove(path)
+assert(#mapped == #output)
+root = TestData.GetRootAsTestData(mapped, 0)
+mapped = nil
+for _ = 1, 3 do collectgarbage() end
+assert(root:Entity() == 42 and root:Str() == "hello")
+assert(not pcall(root.view.bytes.Pad, root.view.bytes, 1, 0))
+root = nil
+collectgarbage()
+
+local missing, err = flatbuffersnative.map_binaryarray(path)
+assert(missing == nil and type(err) == "string")
+
+-- an empty file maps to an empty binary array
+f = assert(io.open(path, "wb"))
+f:close()
+assert(#flatbuffersnative.map_binaryarray(path) == 0)
+os.remove(path)
+
+print("binaryarray ok")
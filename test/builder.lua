@@ -0,0 +1,178 @@
+-- native builder checks, run from the test directory: lua builder.lua
+local __g = _G
+
+-- export global variable
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+
+exports.vector2 = vector2_native
+
+local flatbuffers = require("flatbuffers")
+
+-- more elements than StartVector declared, EndVector grows the buffer for the length
+local b = flatbuffers.Builder(8)
+b:StartVector(4, 0, 4)
+local n = 0
+while b:Head() > 0 do
+    b:PrependInt32(n)
+    n = n + 1
+end
+assert(b:Head() == 0)
+local vec = b:EndVector(n)
+assert(vec == b:Offset())
+b:PrependInt32(7)
+b:Finish(vec)
+local ba = flatbuffersnative.new_binaryarray(b:Output())
+local view = flatbuffersnative.new_view(ba, 0)
+local start = view:Vector(0)
+assert(view:VectorLen(0) == n)
+for j = 1, n do
+    assert(view:Get(flatbuffers.N.Int32, start + (j - 1) * 4) == n - j)
+end
+
+-- two tables with the same layout share one vtable, 8 bytes keep the second one aligned like the first
+local N = flatbuffers.N
+b = flatbuffers.Builder(64)
+local function child(x)
+    b:StartObject(2)
+    b:PrependInt32Slot(0, x, 0)
+    b:PrependInt32Slot(1, -x, 0)
+    return b:EndObject()
+end
+local c1 = child(5)
+local c2 = child(6)
+local deduped, bytes = b:VtableStats()
+assert(deduped == 1 and bytes == 8)
+b:StartObject(3)
+b:PrependUOffsetTRelativeSlot(0, c1, 0)
+b:PrependUOffsetTRelativeSlot(1, c2, 0)
+b:PrependBoolSlot(2, true, false)
+b:Finish(b:EndObject())
+deduped, bytes = b:VtableStats()
+assert(deduped == 1 and bytes == 8)
+
+local output = b:Output()
+ba = flatbuffersnative.new_binaryarray(output)
+local root = flatbuffersnative.new_view(ba, string.unpack("<I4", output))
+local v1 = flatbuffersnative.new_view(ba, root:FieldTable(4))
+local v2 = flatbuffersnative.new_view(ba, root:FieldTable(6))
+assert(root:Field(N.Bool, 8, false) == true)
+assert(v1:Field(N.Int32, 4, 0) == 5 and v1:Field(N.Int32, 6, 0) == -5)
+assert(v2:Field(N.Int32, 4, 0) == 6 and v2:Field(N.Int32, 6, 0) == -6)
+assert(v1.pos - v1:Get(N.Int32, v1.pos) == v2.pos - v2:Get(N.Int32, v2.pos))
+assert(root.pos - root:Get(N.Int32, root.pos) ~= v1.pos - v1:Get(N.Int32, v1.pos))
+
+b:Reset()
+deduped, bytes = b:VtableStats()
+assert(deduped == 0 and bytes == 0)
+
+-- bulk vectors are byte-identical to the StartVector + Prepend loop + EndVector path
+local vectors = {
+    Bool = { true, false, true },
+    Uint8 = { 0, 1, 0xff },
+    Uint16 = { 0, 1, 0xffff },
+    Uint32 = { 0, 1, 0xffffffff },
+    Uint64 = { 0, 1, -1 },
+    Int8 = { -0x80, 0, 0x7f },
+    Int16 = { -0x8000, 0, 0x7fff },
+    Int32 = { math.mininteger >> 32, 0, 0x7fffffff },
+    Int64 = { math.mininteger, 0, math.maxinteger },
+}
+
+local function finish(b, offset)
+    b:Finish(offset)
+    return b:Output()
+end
+
+for name, values in pairs(vectors) do
+    local width = N[name].bytewidth
+    b = flatbuffers.Builder(0)
+    b:StartVector(width, #values, width)
+    for i = #values, 1, -1 do b["Prepend" .. name](b, values[i]) end
+    local expected = finish(b, b:EndVector(#values))
+    b = flatbuffers.Builder(0)
+    assert(finish(b, b:CreateNumberVector(N[name], values)) == expected, name)
+end
+
+local fixeds = { math.fixed64(1), math.fixed64(-2.5), math.fixed64(0) }
+b = flatbuffers.Builder(0)
+b:StartVector(8, #fixeds, 8)
+for i = #fixeds, 1, -1 do b:PrependInt64(math.value64(fixeds[i])) end
+local expected = finish(b, b:EndVector(#fixeds))
+b = flatbuffers.Builder(0)
+assert(finish(b, b:CreateNumberVector(N.Int64, fixeds, true)) == expected)
+
+b = flatbuffers.Builder(0)
+b:StartVector(4, 0, 4)
+expected = finish(b, b:EndVector(0))
+b = flatbuffers.Builder(0)
+assert(finish(b, b:CreateNumberVector(N.Int32, {})) == expected)
+
+-- struct vectors: vector2 elements against the generated Vector2Fix64.Pack
+local Vector2Fix64 = require("protocol.generated.Native_serializer").Vector2Fix64
+local points = {}
+for i = 1, 5 do points[i] = vector2.new(math.fixed64(i), math.fixed64(-i)) end
+b = flatbuffers.Builder(0)
+b:StartVector(16, #points, 8)
+for i = #points, 1, -1 do Vector2Fix64.Pack(b, points[i]) end
+expected = finish(b, b:EndVector(#points))
+b = flatbuffers.Builder(0)
+local offset = b:CreateStructVector(points, { { "x", N.Int64, true }, { "y", N.Int64, true } })
+assert(finish(b, offset) == expected)
+
+-- and a struct with padding, { a: int8, b: int32, c: int16 } is 12 bytes aligned to 4
+local mixed = {}
+for i = 1, 4 do mixed[i] = { a = -i, b = i * 100000, c = i * 100 } end
+b = flatbuffers.Builder(0)
+b:StartVector(12, #mixed, 4)
+for i = #mixed, 1, -1 do
+    b:Prep(4, 12)
+    b:Pad(2)
+    b:PrependInt16(mixed[i].c)
+    b:PrependInt32(mixed[i].b)
+    b:Pad(3)
+    b:PrependInt8(mixed[i].a)
+end
+expected = finish(b, b:EndVector(#mixed))
+b = flatbuffers.Builder(0)
+offset = b:CreateStructVector(mixed, { { "a", N.Int8 }, { "b", N.Int32 }, { "c", N.Int16 } })
+assert(finish(b, offset) == expected)
+
+-- pooled builders: the requested size is honored and oversized buffers are not handed back
+for _ = 1, 4 do
+    local x = flatbuffers.Builder(64)
+    x:Finish(x:CreateString("z"))
+end
+collectgarbage()
+assert(flatbuffers.Builder(1 << 20):Head() >= 1 << 20)
+collectgarbage()
+for _ = 1, 32 do assert(flatbuffers.Builder(16):Head() <= 1 << 16) end
+
+-- full output after Reset starts with zeros, not with the previous message
+b = flatbuffers.Builder(256)
+b:Finish(b:CreateString(string.rep("x", 200)))
+b:Reset()
+b:Finish(b:CreateString("y"))
+local full, used = b:Output(true), b:Output()
+assert(full:sub(-#used) == used)
+assert(full:sub(1, #full - #used) == string.rep("\0", #full - #used))
+ba = flatbuffersnative.new_binaryarray(0)
+b:OutputTo(ba, true)
+assert(ba:Slice(0, #ba) == full)
+
+-- the raw pointer output is not part of the Lua API
+assert(b.OutputPointer == nil)
+
+print("builder ok")
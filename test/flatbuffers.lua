@@ -1,6 +1,6 @@
 local m = {}
 
-m.Builder = require("flatbuffers.builder").New
+m.Builder = flatbuffersnative.new_builder
 m.N = flatbuffersnative.N
 m.view = {}
 m.view.New = flatbuffersnative.new_view
@@ -0,0 +1,128 @@
+-- flatbuffersnative.to_json / from_json checks, run from the test directory: lua json.lua
+local __g = _G
+
+-- export global variable
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+require("lualib_bundle")
+
+exports.vector2 = vector2_native
+
+if not flatbuffersnative.to_json then
+    print("json skipped, built without rapidjson")
+    return
+end
+
+local rapidjson = require("rapidjson")
+local flatbuffers = require("flatbuffers")
+local TestData = require("protocol.generated.Test_serializer").TestData
+local schemas = require("protocol.Test_schema")
+local schema = flatbuffersnative.new_schema(schemas.TestData)
+local options = { fixed_decimal = true }
+
+local function unpack(bytes)
+    return table.concat(vardump(TestData.GetRootAsTestData(flatbuffersnative.new_binaryarray(bytes), 0):UnPack()), "\n")
+end
+
+local TestDataT = require("protocol.generated.Test_generated").TestDataT
+local SomethingElseT = require("protocol.generated.Test_generated").SomethingElseT
+local TableWithArrayT = require("protocol.generated.Test_generated").TableWithArrayT
+local SomeStructT = require("protocol.generated.Test_generated").SomeStructT
+local data = __TS__New(TestDataT)
+data.entity = 42
+data.hasBall = true
+data.characterId = -5
+data.someLong = 1234567890123
+data.someFix64 = math.fixed64(-777.25)
+data.someStruct.someField = 11
+data.someStruct.nestedStruct.nestedStructField = math.fixed64(13.5)
+data.str = "hello \"world\"\n"
+data.bool2 = false
+data.optionalInt = 0
+data.someObj = __TS__New(SomethingElseT)
+data.someObj.someField = 5
+for i = 1, 4 do
+    data.intArray[i] = i * 3 - 100
+    data.someNumberArray[i] = math.fixed64(i) / 3
+    local e = __TS__New(SomethingElseT)
+    e.someField = i
+    data.someOtherArray[i] = e
+    local t = __TS__New(TableWithArrayT)
+    for j = 1, i - 1 do t.someArray[j] = j * 7 end
+    data.arrayOfArray[i] = t
+    local st = __TS__New(SomeStructT)
+    st.someField = i
+    st.nestedStruct.nestedStructField = math.fixed64(-i)
+    data.someArray[i] = st
+    data.someVector2Array[i] = vector2.new(math.fixed64(i), math.fixed64(-i))
+end
+local builder = flatbuffers.Builder(1024)
+builder:Finish(TestData.Pack(builder, data))
+local expected = builder:Output()
+
+-- to_json -> from_json -> UnPack gives back the packed message, with decimals and with raw fixed values
+for _, opts in ipairs({ options, {}, { pretty = true, fixed_decimal = true } }) do
+    local text = assert(flatbuffersnative.to_json(flatbuffersnative.new_binaryarray(expected), schema, opts))
+    local again = assert(flatbuffersnative.from_json(text, schema, opts))
+    assert(unpack(again) == unpack(expected))
+    assert(flatbuffersnative.to_json(flatbuffersnative.new_binaryarray(again), schema, opts) == text)
+end
+
+-- testdata.json goes through from_json -> to_json -> from_json unchanged
+local f = assert(io.open("performance/testdata.json"))
+local json = f:read("*a")
+f:close()
+local bytes = assert(flatbuffersnative.from_json(json, schema, options))
+local text = assert(flatbuffersnative.to_json(flatbuffersnative.new_binaryarray(bytes), schema, options))
+assert(unpack(assert(flatbuffersnative.from_json(text, schema, options))) == unpack(bytes))
+local decoded = rapidjson.decode(json)
+local root = TestData.GetRootAsTestData(flatbuffersnative.new_binaryarray(bytes), 0)
+assert(root:Entity() == decoded.entity and root:Str() == decoded.str and root:SomeLong() == decoded.someLong)
+assert(root:SomeFix64() == 777.25) -- decimal in testdata.json
+assert(root:IntArrayLength() == #decoded.intArray)
+for j = 1, #decoded.intArray do assert(root:IntArray(j) == decoded.intArray[j]) end
+
+-- error paths report the parse offset, just past the offending token
+local function fails(text, message)
+    local ok, err = flatbuffersnative.from_json(text, schema, options)
+    assert(ok == nil and err == message, err)
+end
+fails('{"entity":"x"}', "string not expected (at 13)")
+fails('{"entity":1,"nope":2}', "unknown field (at 18)")
+fails('{"someStruct":"x"}', "string not expected (at 17)")
+fails('{"someStruct":{"someField":1,"nestedStruct":"x"}}', "string not expected (at 47)")
+fails('{"entity":1,"str":"abc', "Missing a closing quotation mark in string. (at 22)")
+fails('{"entity":1,', "Missing a name for object member. (at 12)")
+fails('', "The document is empty. (at 0)")
+fails('[]', "root table expected (at 1)")
+fails('{"entity":1} x', "The document root must not be followed by other values. (at 13)")
+
+-- descriptors with struct members outside the struct or misaligned are rejected
+local function rejected(struct)
+    local ok, err = pcall(flatbuffersnative.new_schema, { name = "T", fields = {
+        { name = "s", type = "struct", ref = struct } } })
+    assert(not ok and err:find("out of the struct or misaligned"), err)
+end
+rejected({ name = "S", struct = true, size = 8, align = 8, fields = {
+    { name = "x", type = "Int64", offset = 8 } } })
+rejected({ name = "S", struct = true, size = 8, align = 4, fields = {
+    { name = "x", type = "Int32", offset = 6 } } })
+rejected({ name = "S", struct = true, size = 8, align = 4, fields = {
+    { name = "x", type = "Int32", offset = 2 } } })
+local ok, err = pcall(flatbuffersnative.new_schema, { name = "T", fields = {
+    { name = "s", type = "struct", ref = { name = "S", struct = true, size = 6, align = 4, fields = {} } } } })
+assert(not ok and err:find("invalid struct size or alignment"), err)
+
+print("json ok")
@@ -0,0 +1,112 @@
+-- FlatBuffers <-> JSON benchmark, run from the test directory: lua performance/json.lua
+-- compares the Lua round trip (UnPack + rapidjson.encode, rapidjson.decode + Pack)
+-- with the native schema-driven transcoder (flatbuffersnative.to_json / from_json)
+local __g = _G
+
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+require("lualib_bundle")
+
+exports.vector2 = vector2_native
+
+local function time(f, times)
+	collectgarbage()
+	local gettime = os.clock
+
+	local ok, socket = pcall(require, 'socket')
+	if ok then
+		gettime = socket.gettime
+	end
+
+	local start = gettime()
+
+	for _=1,times do f() end
+
+	local stop = gettime()
+
+	return stop - start
+end
+
+
+local function readfile(file)
+	local f = io.open(file)
+	if not f then return nil end
+	local d = f:read('*a')
+	f:close()
+	return d
+end
+
+
+local function profile(jsonfile, times)
+	times = times or 1000
+
+	print(jsonfile..': (x'..times..')')
+	print('                     module      decoding      encoding')
+	local d = readfile(jsonfile)
+
+	local rapidjson = require('rapidjson')
+	local flatbuffers = require('flatbuffers')
+	local TestData = require('protocol.generated.Test_serializer').TestData
+	local schema = flatbuffersnative.new_schema(require('protocol.Test_schema').TestData)
+	local options = { fixed_decimal = true }
+
+	local function luaDecode(s)
+		local builder = flatbuffers.Builder(1024)
+		builder:Finish(TestData.Pack(builder, rapidjson.decode(s)))
+		return builder:Output()
+	end
+
+	local function luaEncode(buf)
+		local ba = flatbuffersnative.new_binaryarray(buf)
+		return rapidjson.encode(TestData.GetRootAsTestData(ba, 0):UnPack())
+	end
+
+	local function nativeDecode(s)
+		return flatbuffersnative.from_json(s, schema, options)
+	end
+
+	local function nativeEncode(buf)
+		return flatbuffersnative.to_json(flatbuffersnative.new_binaryarray(buf), schema, options)
+	end
+
+	local modules = {
+		{'Pack/UnPack + rapidjson', luaDecode, luaEncode},
+		{'to_json/from_json', flatbuffersnative.from_json and nativeDecode, flatbuffersnative.to_json and nativeEncode},
+	}
+
+	for _, m in ipairs(modules) do
+		local name, dec, enc = m[1], m[2], m[3]
+		if dec and enc then
+			local td = time(function() dec(d) end, times)
+			local t = dec(d)
+			local te = time(function() enc(t) end, times)
+			print(string.format('% 27s % 13s % 13s', name, tostring(td), tostring(te)))
+		else
+			print(string.format('% 27s %13s %13s', name, 'n/a', 'n/a'))
+		end
+	end
+end
+
+local function main()
+	profile('performance/testdata.json')
+end
+
+local r, m = pcall(main)
+
+if not r then
+	print(m)
+end
+
+return 0
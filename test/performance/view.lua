@@ -0,0 +1,188 @@
+-- field read and vector microbenchmark, run from the test directory: lua performance/view.lua
+local __g = _G
+
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+
+exports.vector2 = vector2_native
+
+local function time(f, times)
+	collectgarbage()
+	local gettime = os.clock
+
+	local ok, socket = pcall(require, 'socket')
+	if ok then
+		gettime = socket.gettime
+	end
+
+	local start = gettime()
+
+	for _=1,times do f() end
+
+	local stop = gettime()
+
+	return stop - start
+end
+
+local function profile(times)
+	times = times or 1000000
+
+	local flatbuffers = require("flatbuffers")
+	local TestDataT = require("protocol.generated.Test_generated").TestDataT
+	local TestData = require("protocol.generated.Test_serializer").TestData
+
+	local data = __TS__New(TestDataT)
+	data.entity = 42
+	data.characterId = 7
+	data.someLong = 1234567890123
+
+	local builder = flatbuffers.Builder(1024)
+	builder:Finish(TestData.Pack(builder, data))
+	local ba = flatbuffersnative.new_binaryarray(builder:Output())
+	local root = TestData.GetRootAsTestData(ba, 0)
+	local view = root.view
+	local N = flatbuffers.N
+	local Int32 = N.Int32
+	local pos = view.pos + view:Offset(4)
+
+	local reads = {
+		{'accessor root:Entity()', function() root:Entity() end},
+		{'view:Get(N.Int32, pos)', function() view:Get(Int32, pos) end},
+		{'view:GetInt32(pos)', view.GetInt32 and function() view:GetInt32(pos) end},
+		{'view:Field(N.Int32, 4, -1)', view.Field and function() view:Field(Int32, 4, -1) end},
+		{'view:Offset(4)', function() view:Offset(4) end},
+	}
+
+	local lookups = {
+		{'view.Offset', function() return view.Offset end},
+		{'view.pos', function() return view.pos end},
+		{'view.bytes', function() return view.bytes end},
+		{'N.Int32.bytewidth', function() return Int32.bytewidth end},
+		{'N.Int32.packFmt', function() return Int32.packFmt end},
+	}
+
+	print('lookups: (x'..times..')')
+	print('                      lookup       seconds   lookups/sec')
+	for _, r in ipairs(lookups) do
+		local name, f = r[1], r[2]
+		local t = time(f, times)
+		print(string.format('% 28s % 13s % 13d', name, tostring(t), math.floor(times / t)))
+	end
+
+	print('field reads: (x'..times..')')
+	print('                        read       seconds     reads/sec')
+	for _, r in ipairs(reads) do
+		local name, f = r[1], r[2]
+		if f then
+			local t = time(f, times)
+			print(string.format('% 28s % 13s % 13d', name, tostring(t), math.floor(times / t)))
+		else
+			print(string.format('% 28s %13s', name, 'n/a'))
+		end
+	end
+
+	local ints = {}
+	for i = 1, 64 do ints[i] = i * 3 - 100 end
+	data.intArray = ints
+	builder = flatbuffers.Builder(1024)
+	builder:Finish(TestData.Pack(builder, data))
+	root = TestData.GetRootAsTestData(flatbuffersnative.new_binaryarray(builder:Output()), 0)
+	view = root.view
+
+	local vectors = {
+		{'StartVector + PrependInt32', function()
+			local b = flatbuffers.Builder(1024)
+			TestData.StartIntArrayVector(b, #ints)
+			for i = #ints, 1, -1 do b:PrependInt32(ints[i]) end
+			b:EndVector(#ints)
+		end},
+		{'CreateNumberVector', builder.CreateNumberVector and function()
+			flatbuffers.Builder(1024):CreateNumberVector(Int32, ints)
+		end},
+		{'accessor root:IntArray(j)', function()
+			local t = {}
+			for j = 1, root:IntArrayLength() do t[j] = root:IntArray(j) end
+		end},
+		{'view:ReadVector(N.Int32, 52)', view.ReadVector and function() view:ReadVector(Int32, 52) end},
+	}
+
+	times = times // 100
+	print('64 element vectors: (x'..times..')')
+	print('                          op       seconds       ops/sec')
+	for _, r in ipairs(vectors) do
+		local name, f = r[1], r[2]
+		if f then
+			local t = time(f, times)
+			print(string.format('% 28s % 13s % 13d', name, tostring(t), math.floor(times / t)))
+		else
+			print(string.format('% 28s %13s', name, 'n/a'))
+		end
+	end
+
+	data.someObj = __TS__New(require("protocol.generated.Test_generated").SomethingElseT)
+	data.str = "relay"
+	data.hasBall = true
+	local shared = flatbuffers.Builder(1024)
+	local out = flatbuffersnative.new_binaryarray(0)
+	shared:Finish(TestData.Pack(shared, data))
+	root = TestData.GetRootAsTestData(flatbuffersnative.new_binaryarray(shared:Output()), 0)
+	view = root.view
+
+	local messages = {
+		{'new Builder + Output', function()
+			local b = flatbuffers.Builder(1024)
+			b:Finish(TestData.Pack(b, data))
+			b:Output()
+		end},
+		{'Reset + OutputTo', shared.Reset and function()
+			shared:Reset()
+			shared:Finish(TestData.Pack(shared, data))
+			shared:OutputTo(out)
+		end},
+		{'accessor root:SomeObj()', function() root:SomeObj() end},
+		{'patch: UnPack + Pack', function()
+			local o = root:UnPack()
+			o.entity = 7
+			o.hasBall = true
+			local b = flatbuffers.Builder(1024)
+			b:Finish(TestData.Pack(b, o))
+			b:Output()
+		end},
+		{'patch: view:Mutate x2', view.Mutate and function()
+			view:Mutate(Int32, 4, 7)
+			view:Mutate(N.Bool, 8, true)
+		end},
+	}
+
+	print('messages: (x'..times..')')
+	print('                          op       seconds       ops/sec')
+	for _, r in ipairs(messages) do
+		local name, f = r[1], r[2]
+		if f then
+			local t = time(f, times)
+			print(string.format('% 28s % 13s % 13d', name, tostring(t), math.floor(times / t)))
+		else
+			print(string.format('% 28s %13s', name, 'n/a'))
+		end
+	end
+end
+
+local r, m = pcall(profile)
+
+if not r then
+	print(m)
+end
+
+return 0
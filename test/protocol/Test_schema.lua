@@ -0,0 +1,57 @@
+-- schema descriptor of Test.fbs for flatbuffersnative.new_schema
+local NestedStruct = { name = "NestedStruct", struct = true, size = 8, align = 8, fields = {
+	{ name = "nestedStructField", type = "Int64", offset = 0, fixed = true } } }
+local SomeStruct = { name = "SomeStruct", struct = true, size = 16, align = 8, fields = {
+	{ name = "someField", type = "Int32", offset = 0 },
+	{ name = "nestedStruct", type = "struct", ref = NestedStruct, offset = 8 } } }
+local Vector2Fix64 = { name = "Vector2Fix64", struct = true, size = 16, align = 8, fields = {
+	{ name = "x", type = "Int64", offset = 0, fixed = true },
+	{ name = "y", type = "Int64", offset = 8, fixed = true } } }
+local SomethingElse = { name = "SomethingElse", fields = {
+	{ name = "someField", type = "Int32" } } }
+local TableWithArray = { name = "TableWithArray", fields = {
+	{ name = "someArray", type = "vector", element = "Int32" } } }
+local TestData = { name = "TestData", fields = {
+	{ name = "entity", type = "Int32" },
+	{ name = "teamEntity", type = "Int32" },
+	{ name = "hasBall", type = "Bool" },
+	{ name = "lastHasBall", type = "Bool" },
+	{ name = "index", type = "Int32" },
+	{ name = "characterId", type = "Int16" },
+	{ name = "roleId", type = "Int16" },
+	{ name = "isAtDefenseTargetPosition", type = "Bool" },
+	{ name = "markedByAthleteId", type = "Int32" },
+	{ name = "someLong", type = "Int64" },
+	{ name = "someFix64", type = "Int64", fixed = true },
+	{ name = "someStruct", type = "struct", ref = SomeStruct },
+	{ name = "someArray", type = "vector", element = "struct", ref = SomeStruct },
+	{ name = "someVector2", type = "struct", ref = Vector2Fix64 },
+	{ name = "someObj", type = "table", ref = SomethingElse },
+	{ name = "someOtherArray", type = "vector", element = "table", ref = SomethingElse },
+	{ name = "someEmptyObj", type = "table", ref = SomethingElse },
+	{ name = "someNumberArray", type = "vector", element = "Int64", fixed = true },
+	{ name = "someVector2Array", type = "vector", element = "struct", ref = Vector2Fix64 },
+	{ name = "optionalNumber", type = "Int64", fixed = true },
+	{ name = "optionalNumber1", type = "Int64", fixed = true },
+	{ name = "optionalNumber2", type = "Int64", fixed = true },
+	{ name = "optionalStruct", type = "struct", ref = SomeStruct },
+	{ name = "optionalStruct1", type = "struct", ref = SomeStruct },
+	{ name = "intArray", type = "vector", element = "Int32" },
+	{ name = "str", type = "string" },
+	{ name = "arrayOfArray", type = "vector", element = "table", ref = TableWithArray },
+	{ name = "bool1", type = "Bool" },
+	{ name = "bool2", type = "Bool" },
+	{ name = "bool3", type = "Bool" },
+	{ name = "bool4", type = "Bool" },
+	{ name = "optionalInt", type = "Int32" },
+	{ name = "optionalInt1", type = "Int32" },
+	{ name = "optionalInt2", type = "Int32" },
+	{ name = "optionalBool", type = "Bool" },
+	{ name = "optionalBool1", type = "Bool" },
+	{ name = "optionalBool2", type = "Bool" } } }
+
+return {
+	TestData = TestData,
+	-- only lists the first field, every other slot is left unchecked by verify
+	TestDataEntityOnly = { name = "TestData", fields = { { name = "entity", type = "Int32" } } },
+}
@@ -0,0 +1,102 @@
+-- flatbuffersnative.verify checks, run from the test directory: lua verify.lua
+local __g = _G
+
+-- export global variable
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+
+exports.vector2 = vector2_native
+
+local flatbuffers = require("flatbuffers")
+local TestDataT = require("protocol.generated.Test_generated").TestDataT
+local TestData = require("protocol.generated.Test_serializer").TestData
+local schemas = require("protocol.Test_schema")
+
+local schema = flatbuffersnative.new_schema(schemas.TestData)
+local partial = flatbuffersnative.new_schema(schemas.TestDataEntityOnly)
+
+local data = __TS__New(TestDataT)
+data.entity = 42
+data.str = "hello"
+data.intArray = { 1, 2, 3 }
+
+local builder = flatbuffers.Builder(1024)
+builder:Finish(TestData.Pack(builder, data))
+local output = builder:Output()
+
+-- intact buffer
+local ba = flatbuffersnative.new_binaryarray(output)
+assert(flatbuffersnative.verify(ba, schema) == true)
+assert(ba:IsVerified() and ba:IsVerified(schema))
+assert(not ba:IsVerified(partial))
+assert(TestData.GetRootAsTestData(ba, 0):Str() == "hello")
+
+-- any write clears the flag
+ba:Pad(0, 0)
+assert(not ba:IsVerified())
+
+-- mutators clear it too, they may overwrite more than the scalar they aim at
+ba = flatbuffersnative.new_binaryarray(output)
+assert(flatbuffersnative.verify(ba, schema) == true)
+assert(TestData.GetRootAsTestData(ba, 0).view:Mutate(flatbuffers.N.Int32, 4, 7) == true)
+assert(not ba:IsVerified())
+
+-- truncated buffer
+for n = 0, #output - 1 do
+    local ok, err = flatbuffersnative.verify(flatbuffersnative.new_binaryarray(output:sub(1, n)), schema)
+    assert(ok == false and type(err) == "string")
+end
+
+-- corrupted string offset
+local function corrupted()
+    local ba = flatbuffersnative.new_binaryarray(output)
+    local view = TestData.GetRootAsTestData(ba, 0).view
+    ba:Set(string.pack("<I4", 0x7fff0000), view.pos + view:Offset(54))
+    return ba
+end
+
+local ba = corrupted()
+local ok, err = flatbuffersnative.verify(ba, schema)
+assert(ok == false and err == "offset target out of range")
+assert(not ba:IsVerified())
+assert(not pcall(TestData.GetRootAsTestData(ba, 0).Str, TestData.GetRootAsTestData(ba, 0)))
+
+-- a partial schema leaves str unchecked, reads through views stay range checked
+ba = corrupted()
+assert(flatbuffersnative.verify(ba, partial) == true)
+assert(ba:IsVerified(partial) and not ba:IsVerified(schema))
+local root = TestData.GetRootAsTestData(ba, 0)
+assert(root:Entity() == 42)
+ok, err = pcall(root.Str, root)
+assert(not ok and err:find("offset out of range"))
+
+-- to_json verifies again against its own schema
+if flatbuffersnative.to_json then
+    ba = corrupted()
+    assert(flatbuffersnative.verify(ba, partial) == true)
+    assert(flatbuffersnative.to_json(ba, partial) == '{"entity":42}')
+    ok, err = flatbuffersnative.to_json(ba, schema)
+    assert(ok == nil and err == "offset target out of range")
+    assert(not ba:IsVerified())
+end
+
+-- nesting and table count limits
+ba = flatbuffersnative.new_binaryarray(output)
+ok, err = flatbuffersnative.verify(ba, schema, { max_depth = 0 })
+assert(ok == false and err == "nesting too deep")
+ok, err = flatbuffersnative.verify(ba, schema, { max_tables = 0 })
+assert(ok == false and err == "too many tables")
+
+print("verify ok")
@@ -0,0 +1,237 @@
+-- native view accessor checks, run from the test directory: lua view.lua
+local __g = _G
+
+-- export global variable
+_G.exports = {}
+setmetatable(
+    exports,
+    {
+        __newindex = function(_, name, value)
+            rawset(__g, name, value)
+        end,
+        __index = function(_, name)
+            return rawget(__g, name)
+        end
+    }
+)
+
+require("func")
+
+exports.vector2 = vector2_native
+
+local flatbuffers = require("flatbuffers")
+local N = flatbuffers.N
+
+-- one field of every scalar type, slot i at vtable offset 4 + 2 * i
+local scalars = {
+    { "Bool", true },
+    { "Uint8", 0xfe },
+    { "Uint16", 0xfffe },
+    { "Uint32", 0xfffffffe },
+    { "Uint64", -2 },
+    { "Int8", -0x7f },
+    { "Int16", -0x7fff },
+    { "Int32", -0x7fffffff },
+    { "Int64", math.mininteger + 1 },
+}
+
+local b = flatbuffers.Builder(64)
+b:StartObject(#scalars + 1) -- the last slot stays absent
+for i, s in ipairs(scalars) do
+    b["Prepend" .. s[1] .. "Slot"](b, i - 1, s[2], nil)
+end
+b:Finish(b:EndObject())
+local output = b:Output()
+local ba = flatbuffersnative.new_binaryarray(output)
+local view = flatbuffersnative.new_view(ba, string.unpack("<I4", output))
+
+for i, s in ipairs(scalars) do
+    local name, value = s[1], s[2]
+    local vt = 4 + 2 * (i - 1)
+    local pos = view.pos + view:Offset(vt)
+    local get = view:Get(N[name], pos)
+    assert(view["Get" .. name](view, pos) == get, name)
+    if name == "Bool" then
+        assert(get == 1 and view:Field(N.Bool, vt, false) == true)
+    else
+        assert(get == value, name)
+        assert(view:Field(N[name], vt, 0) == get, name)
+    end
+    -- absent: the default comes back untouched, whatever its type
+    local absent = 4 + 2 * #scalars
+    assert(view:Field(N[name], absent, nil) == nil)
+    assert(view:Field(N[name], absent, 7) == 7)
+    assert(view:Field(N[name], absent, false, true) == false)
+end
+
+-- fixed converts the raw value through math.fixed64
+local pos = view.pos + view:Offset(4 + 2 * 8)
+assert(view:Field(N.Int64, 4 + 2 * 8, 0, true) == math.fixed64(view:Get(N.Int64, pos)))
+
+-- ReadVector against VectorElem and Get for a vector of every scalar type, slot i at 4 + 2 * i
+local vectors = {
+    { "Bool", { true, false, true } },
+    { "Uint8", { 0, 1, 0xff } },
+    { "Uint16", { 0, 1, 0xffff } },
+    { "Uint32", { 0, 1, 0xffffffff } },
+    { "Uint64", { 0, 1, -1 } },
+    { "Int8", { -0x80, 0, 0x7f } },
+    { "Int16", { -0x8000, 0, 0x7fff } },
+    { "Int32", { -0x80000000, 0, 0x7fffffff } },
+    { "Int64", { math.mininteger, math.value64(math.fixed64(-2.5)), math.maxinteger } },
+}
+b = flatbuffers.Builder(256)
+local offsets = {}
+for i, v in ipairs(vectors) do offsets[i] = b:CreateNumberVector(N[v[1]], v[2]) end
+b:StartObject(#vectors + 1) -- the last slot stays absent
+for i = 1, #vectors do b:PrependUOffsetTRelativeSlot(i - 1, offsets[i], 0) end
+b:Finish(b:EndObject())
+output = b:Output()
+view = flatbuffersnative.new_view(flatbuffersnative.new_binaryarray(output), string.unpack("<I4", output))
+for i, v in ipairs(vectors) do
+    local name, values = v[1], v[2]
+    local vt = 4 + 2 * (i - 1)
+    local t = view:ReadVector(N[name], vt)
+    local start, len = view:FieldVector(vt)
+    assert(#t == #values and len == #values, name)
+    for j = 1, len do
+        local get = view:Get(N[name], start + (j - 1) * N[name].bytewidth)
+        if name == "Bool" then
+            assert(view:VectorElem(N.Bool, vt, j) == (get ~= 0))
+            assert(t[j] == values[j] and t[j] == (get ~= 0))
+        else
+            assert(view:VectorElem(N[name], vt, j) == get, name)
+            assert(t[j] == values[j] and t[j] == get, name)
+        end
+    end
+    assert(#view:ReadVector(N[name], 4 + 2 * #vectors) == 0)
+end
+local t = view:ReadVector(N.Int64, 4 + 2 * 8, true)
+assert(t[2] == math.fixed64(-2.5) and t[2] == math.fixed64(view:VectorElem(N.Int64, 4 + 2 * 8, 2)))
+
+-- the generated accessors agree with the fused ones
+local TestDataT = require("protocol.generated.Test_generated").TestDataT
+local TestData = require("protocol.generated.Test_serializer").TestData
+local data = __TS__New(TestDataT)
+data.entity = 42
+data.hasBall = true
+data.characterId = -5
+data.someLong = 1234567890123
+data.someFix64 = math.fixed64(777)
+data.str = "hello"
+data.intArray = { 3, 1, 4 }
+b = flatbuffers.Builder(1024)
+b:Finish(TestData.Pack(b, data))
+local root = TestData.GetRootAsTestData(flatbuffersnative.new_binaryarray(b:Output()), 0)
+view = root.view
+assert(view:Field(N.Int32, 4, -1) == root:Entity())
+assert(view:Field(N.Bool, 8, false) == root:HasBall())
+assert(view:Field(N.Int16, 14, 0) == root:CharacterId())
+assert(view:Field(N.Int64, 22, 0) == root:SomeLong())
+assert(view:Field(N.Int64, 24, 0, true) == root:SomeFix64())
+assert(view:FieldString(54) == root:Str())
+assert(view:FieldVectorLen(52) == root:IntArrayLength())
+for j = 1, root:IntArrayLength() do
+    assert(view:VectorElem(N.Int32, 52, j) == root:IntArray(j))
+end
+assert(not pcall(view.VectorElem, view, N.Int32, 52, root:IntArrayLength() + 1))
+
+-- Mutate writes every width in place, Field reads the new value back
+local mutated = {
+    { "Bool", false },
+    { "Uint8", 0x12 },
+    { "Uint16", 0x1234 },
+    { "Uint32", 0x12345678 },
+    { "Uint64", 0x123456789abcdef },
+    { "Int8", -0x12 },
+    { "Int16", -0x1234 },
+    { "Int32", -0x12345678 },
+    { "Int64", math.mininteger },
+}
+b = flatbuffers.Builder(64)
+b:StartObject(#scalars + 1)
+for i, s in ipairs(scalars) do
+    b["Prepend" .. s[1] .. "Slot"](b, i - 1, s[2], nil)
+end
+b:Finish(b:EndObject())
+output = b:Output()
+local mba = flatbuffersnative.new_binaryarray(output)
+view = flatbuffersnative.new_view(mba, string.unpack("<I4", output))
+for i, m in ipairs(mutated) do
+    local name, value = m[1], m[2]
+    local vt = 4 + 2 * (i - 1)
+    assert(view:Mutate(N[name], vt, value) == true, name)
+    assert(view:Field(N[name], vt, nil) == value, name)
+    -- the neighbours keep their values
+    for k, s in ipairs(scalars) do
+        if k > i then assert(view:Field(N[s[1]], 4 + 2 * (k - 1), nil) == s[2], name) end
+    end
+end
+assert(view:Mutate(N.Int64, 4 + 2 * 8, math.fixed64(-2.5), true) == true)
+assert(view:Field(N.Int64, 4 + 2 * 8, 0, true) == math.fixed64(-2.5))
+-- absent: nothing to overwrite, the buffer is untouched
+local before = mba:Slice(0, #mba)
+assert(view:Mutate(N.Int32, 4 + 2 * #scalars, 1) == false)
+assert(view:MutateStruct(N.Int32, 4 + 2 * #scalars, 0, 1) == false)
+assert(view:MutateElem(N.Int32, 4 + 2 * #scalars, 1, 1) == false)
+assert(mba:Slice(0, #mba) == before)
+-- past the end is rejected before anything is written
+local tail = flatbuffersnative.new_view(mba, #mba - 2)
+local ok, err = pcall(tail.MutateMember, tail, N.Int32, 0, 1)
+assert(not ok and err:find("offset out of range"))
+local last = flatbuffersnative.new_view(mba, #mba - 1)
+ok, err = pcall(last.MutateMember, last, N.Int16, 0, 1)
+assert(not ok and err:find("offset out of range"))
+ok, err = pcall(last.MutateMember, last, N.Int8, 1, 1)
+assert(not ok and err:find("offset out of range"))
+assert(tail:MutateMember(N.Int16, 0, 0x0102) == true and tail:Get(N.Int16, tail.pos) == 0x0102)
+assert(mba:Slice(0, #mba - 2) == before:sub(1, -3))
+
+-- MutateStruct and MutateMember on an inline { Int32, pad, Int64 } struct
+b = flatbuffers.Builder(64)
+b:StartObject(1)
+b:Prep(8, 16)
+b:PrependInt64(7)
+b:Pad(4)
+b:PrependInt32(3)
+b:PrependStructSlot(0, b:Offset(), 0)
+b:Finish(b:EndObject())
+output = b:Output()
+view = flatbuffersnative.new_view(flatbuffersnative.new_binaryarray(output), string.unpack("<I4", output))
+local spos = view.pos + view:Offset(4)
+assert(view:MutateStruct(N.Int32, 4, 0, -9) == true and view:Get(N.Int32, spos) == -9)
+assert(view:MutateStruct(N.Int64, 4, 8, math.fixed64(1.5), true) == true)
+assert(view:Get(N.Int64, spos + 8) == math.value64(math.fixed64(1.5)))
+local member = flatbuffersnative.new_view(view.bytes, spos)
+assert(member:MutateMember(N.Int64, 8, -1) == true and view:Get(N.Int64, spos + 8) == -1)
+assert(view:Get(N.Int32, spos) == -9)
+
+-- MutateElem on the first and last element of each vector, the index is range-checked
+b = flatbuffers.Builder(256)
+offsets = {}
+for i, v in ipairs(vectors) do offsets[i] = b:CreateNumberVector(N[v[1]], v[2]) end
+b:StartObject(#vectors)
+for i = 1, #vectors do b:PrependUOffsetTRelativeSlot(i - 1, offsets[i], 0) end
+b:Finish(b:EndObject())
+output = b:Output()
+view = flatbuffersnative.new_view(flatbuffersnative.new_binaryarray(output), string.unpack("<I4", output))
+for i, v in ipairs(vectors) do
+    local name, values = v[1], v[2]
+    local vt = 4 + 2 * (i - 1)
+    local first, last = mutated[i][2], values[1]
+    assert(view:MutateElem(N[name], vt, 1, first) == true, name)
+    assert(view:MutateElem(N[name], vt, #values, last) == true, name)
+    local t = view:ReadVector(N[name], vt)
+    assert(t[1] == first and t[2] == values[2] and t[#values] == last, name)
+    ok, err = pcall(view.MutateElem, view, N[name], vt, 0, first)
+    assert(not ok and err:find("vector index out of range"), name)
+    ok, err = pcall(view.MutateElem, view, N[name], vt, #values + 1, first)
+    assert(not ok and err:find("vector index out of range"), name)
+end
+
+-- borrowed bytes belong to someone else
+view = flatbuffersnative.new_view(flatbuffersnative.borrow_binaryarray(output), string.unpack("<I4", output))
+ok, err = pcall(view.Mutate, view, N.Int32, 4, 1)
+assert(not ok and err:find("binary array is read%-only"))
+
+print("view ok")